@@ -0,0 +1,397 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CompletionMatcher.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <cwctype>
+
+namespace {
+
+// Corpora at least this large are scanned by several threads
+const size_t PARALLEL_THRESHOLD = 32768;
+// Candidates filtered at once, and between cancellation checks
+const size_t BATCH_SIZE = 4096;
+
+const int PREFIX_SCORE = 1 << 24;
+const int MATCH_SCORE = 16;
+const int CONSECUTIVE_BONUS = 24;
+const int WORD_START_BONUS = 32;
+const int GAP_PENALTY = 1;
+
+// Bit for a case-folded character in a candidate's character mask. Letters and
+// digits get a bit each; everything else shares the remaining ones.
+uint64_t CharBit(wchar_t c) {
+    if (c >= L'a' && c <= L'z') return uint64_t(1) << (c - L'a');
+    if (c >= L'0' && c <= L'9') return uint64_t(1) << (26 + c - L'0');
+    return uint64_t(1) << (36 + static_cast<unsigned>(c) % 28);
+}
+
+std::wstring Fold(const wchar_t* text, size_t length) {
+    std::wstring folded(text, length);
+    for (auto& c : folded) {
+        c = static_cast<wchar_t>(std::towlower(c));
+    }
+    return folded;
+}
+
+enum CharKind { KIND_LOWER, KIND_UPPER, KIND_DIGIT, KIND_OTHER };
+
+CharKind GetKind(wchar_t c) {
+    if (c < 0x80) {
+        if (c >= L'a' && c <= L'z') return KIND_LOWER;
+        if (c >= L'A' && c <= L'Z') return KIND_UPPER;
+        if (c >= L'0' && c <= L'9') return KIND_DIGIT;
+        return KIND_OTHER;
+    }
+    if (std::iswlower(c)) return KIND_LOWER;
+    if (std::iswupper(c)) return KIND_UPPER;
+    return std::iswalnum(c) ? KIND_DIGIT : KIND_OTHER;
+}
+
+// Whether text[i] starts a word: it follows a separator or is a camelCase hump
+bool IsWordStart(const wchar_t* text, size_t i) {
+    if (i == 0) return true;
+    CharKind prev = GetKind(text[i - 1]);
+    CharKind kind = GetKind(text[i]);
+    if (prev == KIND_OTHER) return kind != KIND_OTHER;
+    return prev == KIND_LOWER && kind == KIND_UPPER;
+}
+
+wxString CurrentWord(const wxString& textToCursor) {
+    int lastSpace = textToCursor.Find(' ', true);
+    if (lastSpace == wxNOT_FOUND) {
+        return textToCursor;
+    }
+    return textToCursor.Mid(lastSpace + 1);
+}
+
+struct Hit {
+    int score;
+    uint32_t length;
+    uint32_t index;
+};
+
+// Higher score first, then shorter candidates, then registration order
+struct RanksBefore {
+    bool operator()(const Hit& a, const Hit& b) const {
+        if (a.score != b.score) return a.score > b.score;
+        if (a.length != b.length) return a.length < b.length;
+        return a.index < b.index;
+    }
+};
+
+// Keeps the best hits seen so far; top() is the worst one kept
+typedef std::priority_queue<Hit, std::vector<Hit>, RanksBefore> HitHeap;
+
+/**
+ * Threads that scan the slices of a large corpus
+ *
+ * Threads are started on first use and kept until the pool is destroyed. The caller
+ * takes slices too, so every slice is scanned even if no thread could be started.
+ */
+class SlicePool {
+public:
+    SlicePool() : m_task(nullptr), m_next(0), m_slices(0), m_running(0), m_stopping(false) {}
+    ~SlicePool();
+    
+    /**
+     * Calls @p task once for each slice in [0, @p slices) and returns when all are done
+     * @return false without calling @p task if another query is using the pool
+     */
+    bool Run(size_t slices, const std::function<void(size_t)>& task);
+    
+private:
+    std::mutex m_busy;   // Held for a whole Run()
+    std::mutex m_mutex;  // Guards the members below
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::vector<std::thread> m_threads;
+    
+    const std::function<void(size_t)>* m_task;
+    size_t m_next;       // First slice not taken yet
+    size_t m_slices;
+    size_t m_running;    // Slices taken but not finished
+    bool m_stopping;
+    
+    void Work();
+};
+
+SlicePool::~SlicePool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+bool SlicePool::Run(size_t slices, const std::function<void(size_t)>& task) {
+    std::unique_lock<std::mutex> busy(m_busy, std::try_to_lock);
+    if (!busy.owns_lock()) return false;
+    
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_threads.size() + 1 < slices) {
+        try {
+            m_threads.emplace_back(&SlicePool::Work, this);
+        } catch (const std::system_error&) {
+            break;  // Scan with the threads there are
+        }
+    }
+    m_task = &task;
+    m_next = 0;
+    m_slices = slices;
+    m_wake.notify_all();
+    
+    while (m_next < m_slices) {
+        size_t slice = m_next++;
+        m_running++;
+        lock.unlock();
+        task(slice);
+        lock.lock();
+        m_running--;
+    }
+    m_done.wait(lock, [this] { return m_running == 0; });
+    m_task = nullptr;
+    return true;
+}
+
+void SlicePool::Work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stopping || (m_task && m_next < m_slices); });
+        if (m_stopping) return;
+        
+        size_t slice = m_next++;
+        m_running++;
+        const std::function<void(size_t)>& task = *m_task;
+        lock.unlock();
+        task(slice);
+        lock.lock();
+        if (--m_running == 0 && m_next >= m_slices) {
+            m_done.notify_all();
+        }
+    }
+}
+
+} // namespace
+
+struct CompletionMatcher::Corpus {
+    std::wstring text;              // Candidates as registered, back to back
+    std::wstring folded;            // Lower-case copy of text
+    std::vector<uint32_t> offsets;  // Start of each candidate, plus the end of the last
+    std::vector<uint64_t> masks;    // CharBit() of every character of each candidate
+    mutable SlicePool pool;         // Scans corpora of PARALLEL_THRESHOLD or more
+    
+    size_t GetCount() const { return masks.size(); }
+    
+    bool Score(const std::wstring& query, size_t index, int& score) const;
+    void Scan(const std::wstring& query, size_t begin, size_t end, size_t maxResults,
+              const CompletionRequest* request, std::vector<Hit>& hits) const;
+    std::vector<wxString> Find(const wxString& query, size_t maxResults,
+                               const CompletionRequest* request) const;
+};
+
+bool CompletionMatcher::Corpus::Score(const std::wstring& query, size_t index, int& score) const {
+    size_t start = offsets[index];
+    size_t length = offsets[index + 1] - start;
+    
+    if (folded.compare(start, query.length(), query) == 0) {
+        score = PREFIX_SCORE;
+        return true;
+    }
+    
+    const wchar_t* candidate = folded.data() + start;
+    const wchar_t* original = text.data() + start;
+    size_t matched = 0;
+    size_t last = 0;
+    score = 0;
+    
+    for (size_t i = 0; i < length && matched < query.length(); i++) {
+        if (candidate[i] != query[matched]) continue;
+        
+        score += MATCH_SCORE;
+        if (matched > 0) {
+            if (i == last + 1) {
+                score += CONSECUTIVE_BONUS;
+            } else {
+                score -= GAP_PENALTY * static_cast<int>(i - last - 1);
+            }
+        }
+        if (IsWordStart(original, i)) {
+            score += WORD_START_BONUS;
+        }
+        last = i;
+        matched++;
+    }
+    
+    return matched == query.length();
+}
+
+void CompletionMatcher::Corpus::Scan(const std::wstring& query, size_t begin, size_t end,
+                                     size_t maxResults, const CompletionRequest* request,
+                                     std::vector<Hit>& hits) const {
+    uint64_t need = 0;
+    for (wchar_t c : query) {
+        need |= CharBit(c);
+    }
+    
+    HitHeap heap;
+    std::vector<uint32_t> survivors(BATCH_SIZE);
+    
+    for (size_t batch = begin; batch < end; batch += BATCH_SIZE) {
+        if (request && request->IsCancelled()) break;
+        
+        // Branch-free prefilter over the packed masks: a candidate survives only if it
+        // contains every query character and is at least as long as the query
+        size_t batchEnd = std::min(end, batch + BATCH_SIZE);
+        size_t count = 0;
+        for (size_t i = batch; i < batchEnd; i++) {
+            survivors[count] = static_cast<uint32_t>(i);
+            count += ((masks[i] & need) == need) & (offsets[i + 1] - offsets[i] >= query.length());
+        }
+        
+        for (size_t k = 0; k < count; k++) {
+            uint32_t index = survivors[k];
+            Hit hit;
+            if (!Score(query, index, hit.score)) continue;
+            hit.length = offsets[index + 1] - offsets[index];
+            hit.index = index;
+            
+            if (heap.size() < maxResults) {
+                heap.push(hit);
+            } else if (RanksBefore()(hit, heap.top())) {
+                heap.pop();
+                heap.push(hit);
+            }
+        }
+    }
+    
+    hits.reserve(heap.size());
+    while (!heap.empty()) {
+        hits.push_back(heap.top());
+        heap.pop();
+    }
+}
+
+std::vector<wxString> CompletionMatcher::Corpus::Find(const wxString& query, size_t maxResults,
+                                                      const CompletionRequest* request) const {
+    std::vector<wxString> results;
+    size_t count = GetCount();
+    if (query.IsEmpty() || maxResults == 0 || count == 0) return results;
+    
+    std::wstring wide = query.ToStdWstring();
+    std::wstring folded = Fold(wide.data(), wide.length());
+    
+    size_t slices = 1;
+    if (count >= PARALLEL_THRESHOLD) {
+        size_t cores = std::max(1u, std::thread::hardware_concurrency());
+        slices = std::min(cores, count / (PARALLEL_THRESHOLD / 2));
+    }
+    
+    // Each slice keeps its own top-k over a contiguous range; the slices are merged below
+    std::vector<std::vector<Hit>> partial(slices);
+    size_t chunk = (count + slices - 1) / slices;
+    std::function<void(size_t)> scanSlice = [&](size_t t) {
+        Scan(folded, t * chunk, std::min(count, (t + 1) * chunk), maxResults, request, partial[t]);
+    };
+    if (slices == 1 || !pool.Run(slices, scanSlice)) {
+        // A concurrent query has the pool, so scan everything here
+        partial.assign(1, std::vector<Hit>());
+        Scan(folded, 0, count, maxResults, request, partial[0]);
+    }
+    
+    std::vector<Hit> hits;
+    for (const auto& slice : partial) {
+        hits.insert(hits.end(), slice.begin(), slice.end());
+    }
+    size_t kept = std::min(maxResults, hits.size());
+    std::partial_sort(hits.begin(), hits.begin() + kept, hits.end(), RanksBefore());
+    
+    results.reserve(kept);
+    for (size_t i = 0; i < kept; i++) {
+        results.push_back(wxString(text.data() + offsets[hits[i].index], hits[i].length));
+    }
+    return results;
+}
+
+CompletionMatcher::CompletionMatcher() : m_corpus(std::make_shared<Corpus>()) {
+}
+
+void CompletionMatcher::SetCandidates(const std::vector<wxString>& candidates) {
+    std::shared_ptr<Corpus> corpus = std::make_shared<Corpus>();
+    std::unordered_set<std::wstring> seen;
+    
+    corpus->offsets.reserve(candidates.size() + 1);
+    corpus->masks.reserve(candidates.size());
+    corpus->offsets.push_back(0);
+    
+    for (const auto& candidate : candidates) {
+        std::wstring wide = candidate.ToStdWstring();
+        if (wide.empty() || !seen.insert(wide).second) continue;
+        
+        std::wstring folded = Fold(wide.data(), wide.length());
+        uint64_t mask = 0;
+        for (wchar_t c : folded) {
+            mask |= CharBit(c);
+        }
+        
+        corpus->text += wide;
+        corpus->folded += folded;
+        corpus->offsets.push_back(static_cast<uint32_t>(corpus->text.length()));
+        corpus->masks.push_back(mask);
+    }
+    
+    m_corpus = corpus;
+}
+
+size_t CompletionMatcher::GetCandidateCount() const {
+    return m_corpus->GetCount();
+}
+
+std::vector<wxString> CompletionMatcher::Match(const wxString& query, size_t maxResults) const {
+    return m_corpus->Find(query, maxResults, nullptr);
+}
+
+CompletionFunc CompletionMatcher::GetCompletionFunction(size_t maxResults) const {
+    std::shared_ptr<const Corpus> corpus = m_corpus;
+    return [corpus, maxResults](const wxString& textToCursor) {
+        return corpus->Find(CurrentWord(textToCursor), maxResults, nullptr);
+    };
+}
+
+AsyncCompletionFunc CompletionMatcher::GetAsyncCompletionFunction(size_t maxResults) const {
+    std::shared_ptr<const Corpus> corpus = m_corpus;
+    return [corpus, maxResults](const wxString& textToCursor, const CompletionRequest& request) {
+        return corpus->Find(CurrentWord(textToCursor), maxResults, &request);
+    };
+}
@@ -0,0 +1,77 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMPLETION_MATCHER_H
+#define COMPLETION_MATCHER_H
+
+#include "CompletionProvider.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+/**
+ * Fuzzy matcher over a fixed list of completion candidates
+ *
+ * Candidates are registered once and copied into a single string pool together with
+ * a case-folded copy and a character mask, so a query allocates nothing per candidate.
+ * A candidate matches when the query is a case-insensitive prefix of it or, failing
+ * that, a subsequence; prefix matches always rank first, subsequence matches are scored
+ * by how many query characters are consecutive or start a word. Only the best
+ * @p maxResults are kept, and large corpora are split across a pool of threads that
+ * lives as long as the corpus. A query that finds the pool busy, or a pool that could
+ * not start its threads, scans on the calling thread.
+ *
+ * The registered corpus is immutable: functions returned by GetCompletionFunction()
+ * keep using the corpus they were created with, and may run on any thread.
+ */
+class CompletionMatcher {
+public:
+    CompletionMatcher();
+    
+    /** Replaces the corpus. Duplicate candidates are stored once. */
+    void SetCandidates(const std::vector<wxString>& candidates);
+    size_t GetCandidateCount() const;
+    
+    /**
+     * @param query The text to match; an empty query matches nothing
+     * @param maxResults The maximum number of candidates to return
+     * @return Matching candidates, best first
+     */
+    std::vector<wxString> Match(const wxString& query, size_t maxResults) const;
+    
+    /**
+     * @return A function for SyntaxTextCtrl::SetCompletionFunction() that matches the
+     *         word before the cursor, i.e. the text after the last space
+     */
+    CompletionFunc GetCompletionFunction(size_t maxResults = 100) const;
+    /** As GetCompletionFunction(), but stops scanning once the request is cancelled */
+    AsyncCompletionFunc GetAsyncCompletionFunction(size_t maxResults = 100) const;
+    
+private:
+    struct Corpus;
+    std::shared_ptr<const Corpus> m_corpus;
+};
+
+#endif // COMPLETION_MATCHER_H
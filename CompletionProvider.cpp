@@ -0,0 +1,136 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CompletionProvider.h"
+#include <utility>
+
+// Texts whose results are kept by a CompletionCache
+static const size_t COMPLETION_CACHE_ENTRIES = 32;
+
+bool CompletionCache::Find(const wxString& text, std::vector<wxString>& completions) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->text == text) {
+            completions = it->completions;
+            if (it != m_entries.begin()) {
+                Entry entry = std::move(*it);
+                m_entries.erase(it);
+                m_entries.push_front(std::move(entry));
+            }
+            return true;
+        }
+    }
+    
+    if (!m_prefixFilterable) {
+        return false;
+    }
+    
+    // Narrow the results of the longest cached text that the current word extends
+    const Entry* base = nullptr;
+    for (const auto& entry : m_entries) {
+        if (entry.text.length() < text.length() && text.StartsWith(entry.text) &&
+            text.find(' ', entry.text.length()) == wxString::npos &&
+            (!base || entry.text.length() > base->text.length())) {
+            base = &entry;
+        }
+    }
+    if (!base) {
+        return false;
+    }
+    
+    size_t wordStart = text.rfind(' ');
+    wxString word = wordStart == wxString::npos ? text : text.Mid(wordStart + 1);
+    
+    completions.clear();
+    for (const auto& completion : base->completions) {
+        if (completion.StartsWith(word)) {
+            completions.push_back(completion);
+        }
+    }
+    Store(text, completions);
+    return true;
+}
+
+void CompletionCache::Store(const wxString& text, const std::vector<wxString>& completions) {
+    m_entries.push_front({text, completions});
+    if (m_entries.size() > COMPLETION_CACHE_ENTRIES) {
+        m_entries.pop_back();
+    }
+}
+
+CompletionWorker::CompletionWorker(AsyncCompletionFunc func, ResultFunc onResult)
+    : m_func(func),
+      m_onResult(onResult),
+      m_generation(0),
+      m_hasRequest(false),
+      m_stopping(false),
+      m_requestGeneration(0) {
+    m_thread = std::thread(&CompletionWorker::Run, this);
+}
+
+CompletionWorker::~CompletionWorker() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    Cancel();
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+unsigned long CompletionWorker::Cancel() {
+    return ++m_generation;
+}
+
+void CompletionWorker::Submit(const wxString& text, unsigned long generation) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requestText = text;
+        m_requestGeneration = generation;
+        m_hasRequest = true;
+    }
+    m_wake.notify_one();
+}
+
+void CompletionWorker::Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stopping || m_hasRequest; });
+        if (m_stopping) return;
+        
+        wxString text = m_requestText;
+        CompletionRequest request(&m_generation, m_requestGeneration);
+        m_requestText.clear();
+        m_hasRequest = false;
+        lock.unlock();
+        
+        if (!request.IsCancelled()) {
+            std::vector<wxString> completions = m_func(text, request);
+            if (!request.IsCancelled()) {
+                m_onResult(request.GetGeneration(), completions);
+            }
+        }
+        
+        lock.lock();
+    }
+}
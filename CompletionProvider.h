@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COMPLETION_PROVIDER_H
+#define COMPLETION_PROVIDER_H
+
+#include <wx/string.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * Lambda type for completion suggestions
+ * @param text The text to complete
+ * @return A vector of completion suggestions
+ */
+using CompletionFunc = std::function<std::vector<wxString>(const wxString&)>;
+
+/**
+ * Recent completion results, by the text they were computed for
+ *
+ * An exact hit serves e.g. a backspace back to a text completed before. For providers
+ * whose results are prefix-filterable, i.e. the results for a longer word are exactly
+ * those results for a shorter one that start with the longer word, typing further into
+ * a word is served by narrowing the list for the shorter text instead. A word is what
+ * follows the last space, as for SyntaxTextModel::ReplaceWordBeforeCursor().
+ */
+class CompletionCache {
+public:
+    CompletionCache() : m_prefixFilterable(false) {}
+    
+    void SetPrefixFilterable(bool filterable) { m_prefixFilterable = filterable; }
+    bool IsPrefixFilterable() const { return m_prefixFilterable; }
+    
+    /** @return false if the provider has to be asked for @p text */
+    bool Find(const wxString& text, std::vector<wxString>& completions);
+    void Store(const wxString& text, const std::vector<wxString>& completions);
+    void Clear() { m_entries.clear(); }
+    
+private:
+    struct Entry {
+        wxString text;
+        std::vector<wxString> completions;
+    };
+    
+    std::deque<Entry> m_entries;  // Most recently used first
+    bool m_prefixFilterable;
+};
+
+/**
+ * Identifies one call to an asynchronous completion provider
+ *
+ * Every keystroke starts a new generation; a request whose generation is no longer
+ * the newest has been superseded and its result will be discarded.
+ */
+class CompletionRequest {
+public:
+    CompletionRequest(const std::atomic<unsigned long>* latest, unsigned long generation)
+        : m_latest(latest), m_generation(generation) {}
+    
+    unsigned long GetGeneration() const { return m_generation; }
+    
+    /** @return true once a newer request has superseded this one. Providers should poll this and return early. */
+    bool IsCancelled() const { return m_latest->load() != m_generation; }
+    
+private:
+    const std::atomic<unsigned long>* m_latest;
+    unsigned long m_generation;
+};
+
+/**
+ * Lambda type for completion suggestions computed off the UI thread
+ * @param text The text to complete
+ * @param request The request being served, for cancellation checks
+ * @return A vector of completion suggestions
+ */
+using AsyncCompletionFunc = std::function<std::vector<wxString>(const wxString&, const CompletionRequest&)>;
+
+/**
+ * Runs an AsyncCompletionFunc on a background thread
+ *
+ * Only the newest submitted request is kept: a request that has not started yet is
+ * replaced by a newer one, and a running one sees IsCancelled() once it is superseded.
+ * Results of superseded requests are dropped, the rest are passed to the result
+ * callback on the worker thread.
+ */
+class CompletionWorker {
+public:
+    using ResultFunc = std::function<void(unsigned long generation, const std::vector<wxString>& completions)>;
+    
+    CompletionWorker(AsyncCompletionFunc func, ResultFunc onResult);
+    /** Cancels the running request and waits for the provider to return */
+    ~CompletionWorker();
+    
+    /**
+     * Supersedes every request submitted so far
+     * @return The generation to use for the next request
+     */
+    unsigned long Cancel();
+    void Submit(const wxString& text, unsigned long generation);
+    
+private:
+    AsyncCompletionFunc m_func;
+    ResultFunc m_onResult;
+    std::atomic<unsigned long> m_generation;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_hasRequest;
+    bool m_stopping;
+    wxString m_requestText;
+    unsigned long m_requestGeneration;
+    
+    std::thread m_thread;
+    
+    void Run();
+};
+
+#endif // COMPLETION_PROVIDER_H
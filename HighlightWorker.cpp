@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "HighlightWorker.h"
+#include <utility>
+
+HighlightWorker::HighlightWorker(ResultFunc onResult)
+    : m_onResult(onResult),
+      m_hasRequest(false),
+      m_stopping(false),
+      m_requestRevision(0),
+      m_budgetChanged(false),
+      m_requestBudget(0) {
+    m_thread = std::thread(&HighlightWorker::Run, this);
+}
+
+HighlightWorker::~HighlightWorker() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void HighlightWorker::Submit(SyntaxGrammarPtr grammar, const wxString& text, unsigned long revision) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requestGrammar = grammar;
+        m_requestText = text;
+        m_requestRevision = revision;
+        m_hasRequest = true;
+    }
+    m_wake.notify_one();
+}
+
+void HighlightWorker::SetMatchBudget(int milliseconds, BudgetExceededFunc func) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requestBudget = milliseconds;
+    m_requestBudgetFunc = func;
+    m_budgetChanged = true;
+}
+
+void HighlightWorker::Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stopping || m_hasRequest; });
+        if (m_stopping) return;
+        
+        HighlightResult result;
+        result.grammar = m_requestGrammar;
+        result.revision = m_requestRevision;
+        TextBuffer text(m_requestText);
+        m_requestGrammar.reset();
+        m_requestText.clear();
+        m_hasRequest = false;
+        if (m_budgetChanged) {
+            m_highlighter.SetMatchBudget(m_requestBudget);
+            m_highlighter.SetBudgetExceededFunction(m_requestBudgetFunc);
+            m_budgetChanged = false;
+        }
+        lock.unlock();
+        
+        if (result.grammar != m_grammar) {
+            m_highlighter.SetGrammar(result.grammar);
+            m_grammar = result.grammar;
+        } else {
+            // Report the difference to the previous snapshot as a single edit
+            size_t oldLength = m_text.GetLength();
+            size_t newLength = text.GetLength();
+            size_t prefix = 0;
+            while (prefix < oldLength && prefix < newLength && m_text[prefix] == text[prefix]) {
+                prefix++;
+            }
+            size_t suffix = 0;
+            while (suffix < oldLength - prefix && suffix < newLength - prefix &&
+                   m_text[oldLength - suffix - 1] == text[newLength - suffix - 1]) {
+                suffix++;
+            }
+            if (prefix != oldLength || prefix != newLength) {
+                m_highlighter.NoteEdit(prefix, oldLength - prefix - suffix, newLength - prefix - suffix);
+            }
+        }
+        
+        m_text = std::move(text);
+        result.tokens = m_highlighter.Update(m_text);
+        m_onResult(result);
+        
+        lock.lock();
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIGHLIGHT_WORKER_H
+#define HIGHLIGHT_WORKER_H
+
+#include <wx/string.h>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "SyntaxHighlighter.h"
+
+/**
+ * Highlighting of one snapshot of a text
+ * @param grammar The grammar the text was highlighted with
+ * @param revision The revision of the text the snapshot was taken at
+ * @param tokens The matched runs, as returned by SyntaxHighlighter::Update()
+ */
+struct HighlightResult {
+    SyntaxGrammarPtr grammar;
+    unsigned long revision;
+    std::vector<StyledSegment> tokens;
+};
+
+/**
+ * Highlights text snapshots on a background thread
+ *
+ * Only the newest submitted snapshot is kept: one that has not been started yet is
+ * replaced by the next. The worker remembers the last snapshot it highlighted and
+ * re-lexes only the part that differs from it. Results are passed to the result
+ * callback on the worker thread.
+ *
+ * The grammar must be cacheable, see SyntaxGrammar::IsCacheable(): a ColorFunc adds
+ * palette entries, which cannot be shared with the thread drawing the text. Its
+ * StyleFuncs are called on the worker thread.
+ */
+class HighlightWorker {
+public:
+    using ResultFunc = std::function<void(const HighlightResult& result)>;
+    
+    explicit HighlightWorker(ResultFunc onResult);
+    /** Waits for the snapshot being highlighted, if any, to finish */
+    ~HighlightWorker();
+    
+    void Submit(SyntaxGrammarPtr grammar, const wxString& text, unsigned long revision);
+    
+    /**
+     * Sets the match budget of the worker's highlighter, see SyntaxHighlighter::SetMatchBudget()
+     *
+     * Takes effect from the next snapshot. @p func is called on the worker thread.
+     */
+    void SetMatchBudget(int milliseconds, BudgetExceededFunc func);
+    
+private:
+    ResultFunc m_onResult;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_hasRequest;
+    bool m_stopping;
+    SyntaxGrammarPtr m_requestGrammar;
+    wxString m_requestText;
+    unsigned long m_requestRevision;
+    bool m_budgetChanged;
+    int m_requestBudget;
+    BudgetExceededFunc m_requestBudgetFunc;
+    
+    // Only used on the worker thread
+    SyntaxHighlighter m_highlighter;
+    SyntaxGrammarPtr m_grammar;
+    TextBuffer m_text;  // The snapshot highlighted last
+    
+    std::thread m_thread;
+    
+    void Run();
+};
+
+#endif // HIGHLIGHT_WORKER_H
@@ -0,0 +1,64 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "PerfCounters.h"
+#include <algorithm>
+#include <cmath>
+
+void LatencyHistogram::Record(std::chrono::steady_clock::duration latency) {
+    double micros = std::chrono::duration<double, std::micro>(latency).count();
+    
+    int bucket = 0;
+    if (micros > 1) {
+        bucket = std::min(BUCKETS - 1, (int)std::ceil(std::log2(micros) * BUCKETS_PER_OCTAVE));
+    }
+    
+    m_buckets[bucket]++;
+    m_count++;
+    m_total += micros;
+    m_max = std::max(m_max, micros);
+}
+
+void LatencyHistogram::Reset() {
+    std::fill(m_buckets, m_buckets + BUCKETS, 0);
+    m_count = 0;
+    m_total = 0;
+    m_max = 0;
+}
+
+double LatencyHistogram::GetPercentile(double fraction) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    
+    size_t rank = (size_t)std::ceil(fraction * m_count);
+    size_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += m_buckets[i];
+        if (seen >= rank && seen > 0) {
+            return std::min(m_max, std::exp2((double)i / BUCKETS_PER_OCTAVE));
+        }
+    }
+    return m_max;
+}
@@ -0,0 +1,92 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Distribution of latencies in fixed logarithmic buckets
+ *
+ * Recording is a few arithmetic operations and no allocation, so histograms can stay
+ * enabled in production builds. Buckets are a quarter of an octave wide from 1 microsecond to
+ * about 16 s, so percentiles are accurate to within 19%; the maximum is exact.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram() { Reset(); }
+    
+    void Record(std::chrono::steady_clock::duration latency);
+    void Reset();
+    
+    size_t GetCount() const { return m_count; }
+    /** All values are in microseconds */
+    double GetTotal() const { return m_total; }
+    double GetMax() const { return m_max; }
+    /** @return The upper bound of the bucket holding the @p fraction quantile, at most GetMax() */
+    double GetPercentile(double fraction) const;
+    
+private:
+    static const int BUCKETS_PER_OCTAVE = 4;
+    static const int BUCKETS = 24 * BUCKETS_PER_OCTAVE;
+    
+    uint32_t m_buckets[BUCKETS];
+    size_t m_count;
+    double m_total;
+    double m_max;
+};
+
+/**
+ * Records the time until it goes out of scope into a histogram
+ *
+ * With a null histogram the clock is never read, which is how disabled counters cost
+ * next to nothing.
+ */
+class PerfTimer {
+public:
+    explicit PerfTimer(LatencyHistogram* histogram)
+        : m_histogram(histogram) {
+        if (m_histogram) {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+    
+    ~PerfTimer() {
+        if (m_histogram) {
+            m_histogram->Record(std::chrono::steady_clock::now() - m_start);
+        }
+    }
+    
+private:
+    LatencyHistogram* m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+    
+    PerfTimer(const PerfTimer&) = delete;
+    PerfTimer& operator=(const PerfTimer&) = delete;
+};
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "SyntaxGrammar.h"
+#include <atomic>
+
+void SyntaxGrammar::AddRule(const std::string& regexPattern, ColorFunc colorFunc) {
+    m_rules.emplace_back(regexPattern, colorFunc);
+}
+
+void SyntaxGrammar::AddRule(const std::string& regexPattern, StyleId style) {
+    m_rules.emplace_back(regexPattern, style);
+}
+
+void SyntaxGrammar::AddRule(const std::string& regexPattern, StyleFunc styleFunc) {
+    m_rules.emplace_back(regexPattern, styleFunc);
+}
+
+void SyntaxGrammar::AddRule(const std::string& regexPattern, const std::vector<GroupStyle>& groupStyles) {
+    m_rules.emplace_back(regexPattern, groupStyles);
+}
+
+void SyntaxGrammar::ClearRules() {
+    m_rules.clear();
+}
+
+StyleId SyntaxGrammar::AddStyle(const TextStyle& style) {
+    if (m_styles.size() > 0xFF) {
+        return STYLE_DEFAULT;
+    }
+    m_styles.push_back(style);
+    return (StyleId)(m_styles.size() - 1);
+}
+
+SyntaxGrammarPtr SyntaxGrammar::Compile() const {
+    static std::atomic<uint64_t> nextId(1);
+    
+    std::shared_ptr<SyntaxGrammar> compiled = std::make_shared<SyntaxGrammar>(*this);
+    compiled->m_id = nextId++;
+    compiled->m_cacheable = true;
+    compiled->m_lexer.Clear();
+    
+    std::vector<std::wstring> patterns;
+    for (auto& rule : compiled->m_rules) {
+        patterns.push_back(rule.source);
+        if (rule.colorFunc) {
+            compiled->m_cacheable = false;
+        }
+        
+        // The automaton never backtracks and can be stopped mid-search; patterns it does
+        // not support keep std::regex, which the match budget only checks between matches
+        rule.automaton.reset();
+        std::shared_ptr<SyntaxLexer> automaton = std::make_shared<SyntaxLexer>();
+        if (automaton->Compile(std::vector<std::wstring>(1, rule.source))) {
+            rule.automaton = automaton;
+        }
+    }
+    if (m_engine == SYNTAX_ENGINE_COMBINED) {
+        compiled->m_lexer.Compile(patterns);
+    }
+    return compiled;
+}
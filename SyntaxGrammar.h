@@ -0,0 +1,245 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SYNTAX_GRAMMAR_H
+#define SYNTAX_GRAMMAR_H
+
+#include <wx/string.h>
+#include <wx/colour.h>
+#include <vector>
+#include <string>
+#include <regex>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include "SyntaxLexer.h"
+
+using ColorFunc = std::function<wxColour(const wxString&)>;
+
+/** Index of a TextStyle in a SyntaxHighlighter's palette */
+using StyleId = uint8_t;
+
+/** The style of text no rule matches; every palette starts with it */
+const StyleId STYLE_DEFAULT = 0;
+
+/**
+ * Appearance of a run of highlighted text
+ * @param foreground The text color
+ * @param background The color behind the text; an invalid color leaves the control's background
+ */
+struct TextStyle {
+    wxColour foreground;
+    wxColour background;
+    bool bold;
+    bool italic;
+    bool underline;
+    
+    TextStyle(const wxColour& foreground = wxColour(0, 0, 0), bool bold = false, bool italic = false,
+              bool underline = false, const wxColour& background = wxColour())
+        : foreground(foreground),
+          background(background),
+          bold(bold),
+          italic(italic),
+          underline(underline) {}
+};
+
+/**
+ * A match of a syntax rule, viewing the text in place
+ *
+ * Group 0 is the whole match, the others are the pattern's capture groups. Nothing
+ * is copied, so a match is only valid during the StyleFunc call it is passed to.
+ */
+class SyntaxMatch {
+public:
+    SyntaxMatch(const wchar_t* data, size_t position, size_t length, const std::wcmatch* groups)
+        : m_data(data), m_position(position), m_length(length), m_groups(groups) {}
+    
+    /** @return The number of groups, including the whole match */
+    size_t GetGroupCount() const { return m_groups ? m_groups->size() : 1; }
+    /** @return false for a group that took no part in the match */
+    bool IsMatched(size_t group) const { return !m_groups || (*m_groups)[group].matched; }
+    
+    /** @return The position of @p group in the text */
+    size_t GetPosition(size_t group = 0) const {
+        return m_groups ? m_position + ((*m_groups)[group].first - m_data) : m_position;
+    }
+    size_t GetLength(size_t group = 0) const {
+        return m_groups ? (size_t)(*m_groups)[group].length() : m_length;
+    }
+    /** @return The first character of @p group; it is not null-terminated */
+    const wchar_t* GetData(size_t group = 0) const { return m_groups ? (*m_groups)[group].first : m_data; }
+    
+    /** Compares @p group with @p text without copying it */
+    bool Equals(size_t group, const wchar_t* text) const {
+        return std::wstring::traits_type::length(text) == GetLength(group) &&
+               std::wstring::traits_type::compare(GetData(group), text, GetLength(group)) == 0;
+    }
+    /** @return A copy of @p group */
+    wxString GetString(size_t group = 0) const { return wxString(GetData(group), GetLength(group)); }
+    
+private:
+    const wchar_t* m_data;
+    size_t m_position;
+    size_t m_length;
+    const std::wcmatch* m_groups;
+};
+
+/**
+ * Picks the style of a match, e.g. from the text of one of its groups
+ *
+ * Results are cached by text, so the function must depend on the match alone.
+ */
+using StyleFunc = std::function<StyleId(const SyntaxMatch&)>;
+
+/**
+ * The style of one capture group of a rule
+ * @param group The group index; 0 is the whole match
+ * @param style The palette entry for the group's text
+ */
+struct GroupStyle {
+    size_t group;
+    StyleId style;
+};
+
+/**
+ * Structure to hold syntax highlighting rules
+ * @param pattern The regex pattern to match
+ * @param colorFunc The function to color the matched text, if any
+ * @param styleFunc The function to pick a style from a view of the match, if any
+ * @param style The palette entry for every match when there is no function
+ * @param groupStyles Styles for individual capture groups, used instead of all of the above
+ * @param automaton Finds the matches instead of @p pattern, which then only splits them
+ *                  into groups; set by SyntaxGrammar::Compile() unless the pattern
+ *                  uses syntax the automaton does not support
+ */
+struct SyntaxRule {
+    std::wstring source;
+    std::wregex pattern;
+    ColorFunc colorFunc;
+    StyleFunc styleFunc;
+    StyleId style;
+    std::vector<GroupStyle> groupStyles;
+    std::shared_ptr<const SyntaxLexer> automaton;
+    
+    SyntaxRule(const std::string& regexPattern, ColorFunc func)
+        : source(wxString::FromUTF8(regexPattern.c_str()).ToStdWstring()),
+          pattern(source),
+          colorFunc(func),
+          style(STYLE_DEFAULT) {}
+    
+    SyntaxRule(const std::string& regexPattern, StyleFunc func)
+        : source(wxString::FromUTF8(regexPattern.c_str()).ToStdWstring()),
+          pattern(source),
+          styleFunc(func),
+          style(STYLE_DEFAULT) {}
+    
+    SyntaxRule(const std::string& regexPattern, StyleId style)
+        : source(wxString::FromUTF8(regexPattern.c_str()).ToStdWstring()),
+          pattern(source),
+          style(style) {}
+    
+    SyntaxRule(const std::string& regexPattern, const std::vector<GroupStyle>& groups)
+        : source(wxString::FromUTF8(regexPattern.c_str()).ToStdWstring()),
+          pattern(source),
+          style(STYLE_DEFAULT),
+          groupStyles(groups) {}
+    
+    /** @return true if matches must be split into capture groups */
+    bool NeedsGroups() const { return styleFunc || !groupStyles.empty(); }
+};
+
+/**
+ * How syntax rules are matched against the text
+ */
+enum SyntaxEngine {
+    SYNTAX_ENGINE_REGEX,    ///< One pass per rule, on its own automaton or on std::regex
+    SYNTAX_ENGINE_COMBINED  ///< All rules in a single automaton, see SyntaxLexer
+};
+
+class SyntaxGrammar;
+
+/** A compiled grammar, shared between highlighters */
+using SyntaxGrammarPtr = std::shared_ptr<const SyntaxGrammar>;
+
+/**
+ * Highlighting rules, their palette and the matching engine
+ *
+ * Fill a grammar in, then Compile() it once and pass the result to any number of
+ * controls: the regexes and the combined automaton are built a single time and
+ * shared read-only, also between threads. Each highlighter starts from a copy of
+ * the grammar's palette, so restyling one control does not affect the others.
+ */
+class SyntaxGrammar {
+public:
+    SyntaxGrammar() : m_styles(1), m_engine(SYNTAX_ENGINE_REGEX), m_id(0), m_cacheable(true) {}
+    
+    void AddRule(const std::string& regexPattern, ColorFunc colorFunc);
+    /** Adds a rule that draws every match with the palette entry @p style */
+    void AddRule(const std::string& regexPattern, StyleId style);
+    /** Adds a rule whose function picks the style of each match from a view of its text */
+    void AddRule(const std::string& regexPattern, StyleFunc styleFunc);
+    /**
+     * Adds a rule that styles capture groups separately, e.g. {{1, keyword}, {2, name}}
+     *
+     * Groups are painted in the order given, so later entries win where groups
+     * nest; text of the match that no listed group covers keeps the default style.
+     */
+    void AddRule(const std::string& regexPattern, const std::vector<GroupStyle>& groupStyles);
+    void ClearRules();
+    const std::vector<SyntaxRule>& GetRules() const { return m_rules; }
+    
+    /** @return The id of the new palette entry, or STYLE_DEFAULT if all 256 are in use */
+    StyleId AddStyle(const TextStyle& style);
+    const std::vector<TextStyle>& GetStyles() const { return m_styles; }
+    
+    /**
+     * Selects the matching engine. SYNTAX_ENGINE_COMBINED falls back to matching rule
+     * by rule while any rule uses syntax the combined lexer does not support.
+     */
+    void SetEngine(SyntaxEngine engine) { m_engine = engine; }
+    SyntaxEngine GetEngine() const { return m_engine; }
+    
+    /**
+     * @return An immutable copy with the combined automaton built, ready to be shared.
+     *         Every rule SyntaxLexer supports also gets an automaton of its own.
+     */
+    SyntaxGrammarPtr Compile() const;
+    
+    /** @return The combined automaton; only compiled in grammars returned by Compile() */
+    const SyntaxLexer& GetLexer() const { return m_lexer; }
+    /** @return A process-wide unique id of a compiled grammar, 0 before Compile() */
+    uint64_t GetId() const { return m_id; }
+    /** @return true if results only depend on the text, i.e. no rule uses a ColorFunc */
+    bool IsCacheable() const { return m_cacheable; }
+    
+private:
+    std::vector<SyntaxRule> m_rules;
+    std::vector<TextStyle> m_styles;
+    SyntaxEngine m_engine;
+    SyntaxLexer m_lexer;
+    uint64_t m_id;
+    bool m_cacheable;
+};
+
+#endif // SYNTAX_GRAMMAR_H
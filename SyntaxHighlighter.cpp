@@ -0,0 +1,552 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "SyntaxHighlighter.h"
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <mutex>
+
+// Characters re-lexed on either side of an edit before widening the window
+static const size_t HIGHLIGHT_CONTEXT = 256;
+
+// Bounds of the process-wide cache of highlighting results
+static const size_t RESULT_CACHE_ENTRIES = 512;
+static const size_t RESULT_CACHE_MAX_LENGTH = 4096;
+
+// Time each rule, or the combined automaton, may take per update in milliseconds, and
+// the longest a rule that keeps exceeding it is skipped for, in updates
+static const int DEFAULT_MATCH_BUDGET = 20;
+static const unsigned MAX_BUDGET_PENALTY = 64;
+
+namespace {
+
+/**
+ * Results of highlighting whole texts, shared by all highlighters
+ *
+ * Entries are keyed by grammar id and text and evicted least recently used first.
+ * The text is stored with each entry, so a hash collision cannot return wrong tokens.
+ */
+class ResultCache {
+public:
+    bool Find(uint64_t grammar, const wchar_t* text, size_t length, std::vector<StyledSegment>& tokens) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto range = m_index.equal_range(Hash(grammar, text, length));
+        for (auto it = range.first; it != range.second; ++it) {
+            const Entry& entry = *it->second;
+            if (entry.grammar == grammar && entry.text.compare(0, entry.text.npos, text, length) == 0) {
+                tokens = entry.tokens;
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void Store(uint64_t grammar, const wchar_t* text, size_t length, const std::vector<StyledSegment>& tokens) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t hash = Hash(grammar, text, length);
+        m_entries.push_front({grammar, hash, std::wstring(text, length), tokens});
+        m_index.emplace(hash, m_entries.begin());
+        
+        if (m_entries.size() > RESULT_CACHE_ENTRIES) {
+            auto range = m_index.equal_range(m_entries.back().hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == std::prev(m_entries.end())) {
+                    m_index.erase(it);
+                    break;
+                }
+            }
+            m_entries.pop_back();
+        }
+    }
+    
+private:
+    struct Entry {
+        uint64_t grammar;
+        size_t hash;
+        std::wstring text;
+        std::vector<StyledSegment> tokens;
+    };
+    
+    std::mutex m_mutex;
+    std::list<Entry> m_entries;  // Most recently used first
+    std::unordered_multimap<size_t, std::list<Entry>::iterator> m_index;
+    
+    // FNV-1a over the grammar id and the characters
+    static size_t Hash(uint64_t grammar, const wchar_t* text, size_t length) {
+        uint64_t hash = 14695981039346656037ULL ^ grammar;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ (uint64_t)text[i]) * 1099511628211ULL;
+        }
+        return (size_t)hash;
+    }
+};
+
+ResultCache& GetResultCache() {
+    static ResultCache cache;
+    return cache;
+}
+
+}
+
+SyntaxHighlighter::SyntaxHighlighter()
+    : m_styles(1),
+      m_valid(false),
+      m_resultCaching(true),
+      m_dirty(false),
+      m_dirtyStart(0),
+      m_dirtyEnd(0),
+      m_dirtyDelta(0),
+      m_perfStats(nullptr),
+      m_matchBudget(DEFAULT_MATCH_BUDGET),
+      m_lexerBudget{0, 1},
+      m_revision(0),
+      m_incomplete(false) {
+    static const SyntaxGrammarPtr empty = SyntaxGrammar().Compile();
+    m_grammar = empty;
+}
+
+void SyntaxHighlighter::SetGrammar(SyntaxGrammarPtr grammar) {
+    m_grammar = grammar;
+    m_draft.reset();
+    m_styles = grammar->GetStyles();
+    m_colorStyles.clear();
+    m_ruleBudgets.clear();
+    m_lexerBudget = RuleBudget{0, 1};
+    m_valid = false;
+}
+
+SyntaxGrammarPtr SyntaxHighlighter::GetGrammar() {
+    if (m_draft) {
+        m_grammar = m_draft->Compile();
+        m_draft.reset();
+        m_ruleBudgets.clear();
+        m_lexerBudget = RuleBudget{0, 1};
+    }
+    return m_grammar;
+}
+
+void SyntaxHighlighter::AddRule(const std::string& regexPattern, ColorFunc colorFunc) {
+    EditGrammar().AddRule(regexPattern, colorFunc);
+}
+
+void SyntaxHighlighter::AddRule(const std::string& regexPattern, StyleId style) {
+    EditGrammar().AddRule(regexPattern, style);
+}
+
+void SyntaxHighlighter::AddRule(const std::string& regexPattern, StyleFunc styleFunc) {
+    EditGrammar().AddRule(regexPattern, styleFunc);
+}
+
+void SyntaxHighlighter::AddRule(const std::string& regexPattern, const std::vector<GroupStyle>& groupStyles) {
+    EditGrammar().AddRule(regexPattern, groupStyles);
+}
+
+void SyntaxHighlighter::ClearRules() {
+    EditGrammar().ClearRules();
+}
+
+StyleId SyntaxHighlighter::AddStyle(const TextStyle& style) {
+    if (m_styles.size() > 0xFF) {
+        return STYLE_DEFAULT;
+    }
+    m_styles.push_back(style);
+    return (StyleId)(m_styles.size() - 1);
+}
+
+void SyntaxHighlighter::SetStyle(StyleId id, const TextStyle& style) {
+    if (id < m_styles.size()) {
+        m_styles[id] = style;
+    }
+}
+
+void SyntaxHighlighter::SetEngine(SyntaxEngine engine) {
+    if (engine == GetEngine()) return;
+    EditGrammar().SetEngine(engine);
+}
+
+SyntaxGrammar& SyntaxHighlighter::EditGrammar() {
+    // Copy on first write; a shared grammar is never modified
+    if (!m_draft) {
+        m_draft.reset(new SyntaxGrammar(*m_grammar));
+    }
+    m_valid = false;
+    return *m_draft;
+}
+
+void SyntaxHighlighter::NoteEdit(size_t pos, size_t removed, size_t inserted) {
+    if (!m_valid) return;
+    
+    if (!m_dirty) {
+        m_dirty = true;
+        m_dirtyStart = pos;
+        m_dirtyEnd = pos + inserted;
+        m_dirtyDelta = 0;
+    } else {
+        // Map the end of the existing range through this edit, then take the union
+        size_t end = m_dirtyEnd;
+        if (end >= pos + removed) {
+            end = end - removed + inserted;
+        } else if (end > pos) {
+            end = pos + inserted;
+        }
+        m_dirtyStart = std::min(m_dirtyStart, pos);
+        m_dirtyEnd = std::max(end, pos + inserted);
+    }
+    m_dirtyDelta += (long)inserted - (long)removed;
+}
+
+const std::vector<StyledSegment>& SyntaxHighlighter::Update(const wxString& text) {
+    TextBuffer buffer(text);
+    return Update(buffer);
+}
+
+const std::vector<StyledSegment>& SyntaxHighlighter::Update(TextBuffer& text) {
+    size_t length = text.GetLength();
+    
+    if (m_valid && !m_dirty) {
+        return m_tokens;
+    }
+    
+    GetGrammar();
+    
+    PerfTimer timer(m_perfStats ? &m_perfStats->update : nullptr);
+    
+    // Tokens missing a skipped rule's matches cannot be spliced into, the text is
+    // highlighted from scratch so that a recovered rule shows everywhere
+    m_revision++;
+    if (m_incomplete) {
+        m_valid = false;
+        m_incomplete = false;
+    }
+    
+    if (m_valid) {
+        m_dirtyEnd = std::min(m_dirtyEnd, length);
+        
+        for (size_t context = HIGHLIGHT_CONTEXT; context < length; context *= 2) {
+            size_t from = m_dirtyStart > context ? m_dirtyStart - context : 0;
+            size_t to = std::min(length, m_dirtyEnd + context);
+            size_t oldTo = (size_t)((long)to - m_dirtyDelta);
+            
+            // Cached tokens before the window are kept, those after it are shifted,
+            // and the window is widened so that it never cuts a cached token in half
+            size_t first = std::partition_point(m_tokens.begin(), m_tokens.end(),
+                [from](const StyledSegment& t) { return t.start + t.length <= from; }) - m_tokens.begin();
+            if (first < m_tokens.size() && m_tokens[first].start < from) {
+                from = m_tokens[first].start;
+            }
+            size_t last = std::partition_point(m_tokens.begin(), m_tokens.end(),
+                [oldTo](const StyledSegment& t) { return t.start < oldTo; }) - m_tokens.begin();
+            if (last > first && m_tokens[last - 1].start + m_tokens[last - 1].length > oldTo) {
+                oldTo = m_tokens[last - 1].start + m_tokens[last - 1].length;
+                to = (size_t)((long)oldTo + m_dirtyDelta);
+            }
+            
+            std::vector<StyledSegment> window;
+            Lex(text, from, to, window);
+            
+            // The edit may reach further than the window, e.g. a new quote re-pairs every
+            // string after it. Only accept the window once the matches on both sides of
+            // the dirty range agree with the cached ones.
+            if (!MatchesCached(window, first, last, 0, m_dirtyStart, 0) ||
+                !MatchesCached(window, first, last, m_dirtyEnd, to, m_dirtyDelta)) {
+                continue;
+            }
+            
+            std::vector<StyledSegment> tokens;
+            tokens.reserve(first + window.size() + m_tokens.size() - last);
+            tokens.insert(tokens.end(), m_tokens.begin(), m_tokens.begin() + first);
+            tokens.insert(tokens.end(), window.begin(), window.end());
+            for (size_t i = last; i < m_tokens.size(); i++) {
+                tokens.push_back(m_tokens[i]);
+                tokens.back().start = (uint32_t)((long)tokens.back().start + m_dirtyDelta);
+            }
+            m_tokens.swap(tokens);
+            m_dirty = false;
+            return m_tokens;
+        }
+    }
+    
+    // No cached state, or the edit reaches across most of the text
+    m_tokens.clear();
+    bool cacheable = m_resultCaching && m_grammar->IsCacheable() && length <= RESULT_CACHE_MAX_LENGTH;
+    if (!cacheable || !GetResultCache().Find(m_grammar->GetId(), text.GetView(0, length), length, m_tokens)) {
+        Lex(text, 0, length, m_tokens);
+        if (cacheable && !m_incomplete) {
+            GetResultCache().Store(m_grammar->GetId(), text.GetView(0, length), length, m_tokens);
+        }
+    }
+    m_valid = true;
+    m_dirty = false;
+    return m_tokens;
+}
+
+bool SyntaxHighlighter::MatchesCached(const std::vector<StyledSegment>& window,
+                                      size_t first, size_t last,
+                                      size_t from, size_t to, long delta) const {
+    auto next = [from, to](const std::vector<StyledSegment>& tokens, size_t& i, size_t end, long shift) {
+        while (i < end) {
+            size_t start = (size_t)((long)tokens[i].start + shift);
+            if (start >= from && start + tokens[i].length <= to) return true;
+            i++;
+        }
+        return false;
+    };
+    
+    size_t i = 0, j = first;
+    for (;;) {
+        bool hasNew = next(window, i, window.size(), 0);
+        bool hasOld = next(m_tokens, j, last, delta);
+        if (!hasNew || !hasOld) return hasNew == hasOld;
+        if ((long)window[i].start != (long)m_tokens[j].start + delta ||
+            window[i].length != m_tokens[j].length) {
+            return false;
+        }
+        i++;
+        j++;
+    }
+}
+
+void SyntaxHighlighter::Lex(TextBuffer& text, size_t from, size_t to,
+                            std::vector<StyledSegment>& tokens) {
+    if (from >= to) {
+        return;
+    }
+    
+    // Keep the character before the window so anchors such as \b see it. The window
+    // is read in place; only a ColorFunc gets a copy of its match.
+    size_t lead = from > 0 ? 1 : 0;
+    const wchar_t* chunk = text.GetView(from - lead, to);
+    size_t chunkLength = to - from + lead;
+    
+    const std::vector<SyntaxRule>& rules = m_grammar->GetRules();
+    const SyntaxLexer& lexer = m_grammar->GetLexer();
+    
+    if (m_grammar->GetEngine() == SYNTAX_ENGINE_COMBINED && lexer.IsCompiled() &&
+        m_revision >= m_lexerBudget.resumeAt) {
+        std::chrono::steady_clock::time_point deadline;
+        if (m_matchBudget > 0) {
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_matchBudget);
+        }
+        
+        std::vector<SyntaxToken> found;
+        if (lexer.Scan(chunk, chunkLength, lead, found, m_matchBudget > 0 ? &deadline : nullptr)) {
+            m_lexerBudget.penalty = 1;
+            for (const auto& token : found) {
+                const SyntaxRule& rule = rules[token.rule];
+                const wchar_t* begin = chunk + token.start;
+                
+                // The automaton only finds the extent of a match; std::regex splits it into groups
+                const std::wcmatch* groups = nullptr;
+                if (rule.NeedsGroups() &&
+                    std::regex_match(begin, begin + token.length, m_groups, rule.pattern,
+                                     token.start > 0 ? std::regex_constants::match_prev_avail
+                                                     : std::regex_constants::match_default)) {
+                    groups = &m_groups;
+                }
+                AddMatch(rule, SyntaxMatch(begin, from + token.start - lead, token.length, groups), tokens);
+            }
+            return;
+        }
+        
+        // Match rule by rule instead, each under its own budget, so the slow ones are
+        // found and skipped; try the combined automaton again after the back-off
+        Suspend(m_lexerBudget);
+    }
+    
+    std::regex_constants::match_flag_type flags = lead ? std::regex_constants::match_prev_avail
+                                                       : std::regex_constants::match_default;
+    std::vector<bool> matched(to - from, false);
+    size_t firstToken = tokens.size();
+    
+    if (m_perfStats && m_perfStats->rules.size() < rules.size()) {
+        m_perfStats->rules.resize(rules.size());
+    }
+    
+    std::vector<SyntaxToken> found;
+    
+    for (size_t r = 0; r < rules.size(); r++) {
+        const SyntaxRule& rule = rules[r];
+        if (IsRuleSuspended(r)) {
+            m_incomplete = true;
+            continue;
+        }
+        
+        PerfTimer timer(m_perfStats ? &m_perfStats->rules[r] : nullptr);
+        size_t ruleFirstToken = tokens.size();
+        m_ruleMatches.clear();
+        
+        // Claims the match at start unless an earlier rule got any of it
+        auto claim = [&](size_t start, size_t length, const std::wcmatch* groups) {
+            for (size_t i = start; i < start + length; i++) {
+                if (matched[i]) return;
+            }
+            
+            AddMatch(rule, SyntaxMatch(chunk + lead + start, from + start, length, groups), tokens);
+            std::fill(matched.begin() + start, matched.begin() + start + length, true);
+            if (m_matchBudget > 0) {
+                m_ruleMatches.emplace_back(start, length);
+            }
+        };
+        
+        std::chrono::steady_clock::time_point deadline;
+        if (m_matchBudget > 0) {
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_matchBudget);
+        }
+        
+        bool exceeded = false;
+        
+        if (rule.automaton) {
+            // The automaton checks the deadline while it scans, also when it finds nothing
+            found.clear();
+            exceeded = !rule.automaton->Scan(chunk, chunkLength, lead, found, m_matchBudget > 0 ? &deadline : nullptr);
+            for (size_t i = 0; i < found.size() && !exceeded; i++) {
+                const SyntaxToken& token = found[i];
+                const wchar_t* begin = chunk + token.start;
+                const std::wcmatch* groups = nullptr;
+                if (rule.NeedsGroups() &&
+                    std::regex_match(begin, begin + token.length, m_groups, rule.pattern,
+                                     token.start > 0 ? std::regex_constants::match_prev_avail
+                                                     : std::regex_constants::match_default)) {
+                    groups = &m_groups;
+                }
+                claim(token.start - lead, token.length, groups);
+                exceeded = m_matchBudget > 0 && std::chrono::steady_clock::now() > deadline;
+            }
+        } else {
+            // Only checked between matches: a single search that backtracks or finds
+            // nothing runs to its end
+            std::wcregex_iterator it(chunk + lead, chunk + chunkLength, rule.pattern, flags);
+            std::wcregex_iterator end;
+            
+            for (; it != end; ++it) {
+                claim(it->position(), it->length(), &*it);
+                
+                if (m_matchBudget > 0 && std::chrono::steady_clock::now() > deadline) {
+                    exceeded = true;
+                    break;
+                }
+            }
+        }
+        
+        if (exceeded) {
+            // Leave the rule's text to the rules after it, as if it had not run
+            tokens.resize(ruleFirstToken);
+            for (const auto& range : m_ruleMatches) {
+                std::fill(matched.begin() + range.first, matched.begin() + range.first + range.second, false);
+            }
+            SuspendRule(r, chunk + lead, chunkLength - lead);
+        } else if (r < m_ruleBudgets.size()) {
+            m_ruleBudgets[r].penalty = 1;
+        }
+    }
+    
+    std::sort(tokens.begin() + firstToken, tokens.end(),
+              [](const StyledSegment& a, const StyledSegment& b) {
+                  return a.start < b.start;
+              });
+}
+
+bool SyntaxHighlighter::IsRuleSuspended(size_t rule) const {
+    return rule < m_ruleBudgets.size() && m_revision < m_ruleBudgets[rule].resumeAt;
+}
+
+void SyntaxHighlighter::SuspendRule(size_t rule, const wchar_t* text, size_t length) {
+    if (m_ruleBudgets.size() <= rule) {
+        m_ruleBudgets.resize(rule + 1, RuleBudget{0, 1});
+    }
+    
+    Suspend(m_ruleBudgets[rule]);
+    if (m_budgetExceededFunc) {
+        m_budgetExceededFunc(m_grammar->GetRules()[rule], wxString(text, length));
+    }
+}
+
+void SyntaxHighlighter::Suspend(RuleBudget& budget) {
+    // Skipped for the rest of this update, then for longer each time it fails in a row
+    budget.resumeAt = m_revision + 1 + budget.penalty;
+    budget.penalty = std::min(MAX_BUDGET_PENALTY, budget.penalty * 2);
+    m_incomplete = true;
+}
+
+void SyntaxHighlighter::AddMatch(const SyntaxRule& rule, const SyntaxMatch& match,
+                                 std::vector<StyledSegment>& tokens) {
+    size_t position = match.GetPosition();
+    size_t length = match.GetLength();
+    
+    if (rule.groupStyles.empty()) {
+        StyleId style = rule.style;
+        if (rule.styleFunc) {
+            style = rule.styleFunc(match);
+        } else if (rule.colorFunc) {
+            style = GetColorStyle(rule.colorFunc(match.GetString()));
+        }
+        AppendSegment(tokens, position, length, style);
+        return;
+    }
+    
+    m_groupPaint.assign(length, -1);
+    for (const auto& groupStyle : rule.groupStyles) {
+        if (groupStyle.group >= match.GetGroupCount() || !match.IsMatched(groupStyle.group)) continue;
+        auto first = m_groupPaint.begin() + (match.GetPosition(groupStyle.group) - position);
+        std::fill(first, first + match.GetLength(groupStyle.group), groupStyle.style);
+    }
+    
+    for (size_t i = 0; i < length;) {
+        size_t end = i + 1;
+        while (end < length && m_groupPaint[end] == m_groupPaint[i]) {
+            end++;
+        }
+        if (m_groupPaint[i] >= 0) {
+            AppendSegment(tokens, position + i, end - i, (StyleId)m_groupPaint[i]);
+        }
+        i = end;
+    }
+}
+
+StyleId SyntaxHighlighter::GetColorStyle(const wxColour& color) {
+    uint32_t key = (uint32_t)color.Red() << 24 | (uint32_t)color.Green() << 16 |
+                   (uint32_t)color.Blue() << 8 | color.Alpha();
+    auto it = m_colorStyles.find(key);
+    if (it != m_colorStyles.end()) {
+        return it->second;
+    }
+    
+    StyleId id = AddStyle(TextStyle(color));
+    if (id != STYLE_DEFAULT) {
+        m_colorStyles[key] = id;
+    }
+    return id;
+}
+
+void SyntaxHighlighter::AppendSegment(std::vector<StyledSegment>& segments, size_t start, size_t length,
+                                      StyleId style) {
+    while (length > 0) {
+        size_t chunk = std::min(length, STYLED_SEGMENT_MAX_LENGTH);
+        segments.push_back({(uint32_t)start, (uint16_t)chunk, style});
+        start += chunk;
+        length -= chunk;
+    }
+}
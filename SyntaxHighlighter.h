@@ -0,0 +1,217 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SYNTAX_HIGHLIGHTER_H
+#define SYNTAX_HIGHLIGHTER_H
+
+#include <wx/string.h>
+#include <wx/colour.h>
+#include <vector>
+#include <string>
+#include <regex>
+#include <unordered_map>
+#include <cstdint>
+#include "SyntaxGrammar.h"
+#include "TextBuffer.h"
+#include "PerfCounters.h"
+
+/**
+ * A highlighted run of text, 8 bytes
+ * @param start The position of the first character
+ * @param length The number of characters; longer runs are split
+ * @param style The palette entry to draw the run with
+ */
+struct StyledSegment {
+    uint32_t start;
+    uint16_t length;
+    StyleId style;
+};
+
+/** The longest run a StyledSegment can hold */
+const size_t STYLED_SEGMENT_MAX_LENGTH = 0xFFFF;
+
+/**
+ * Time spent highlighting
+ * @param update Update() calls that found edits or an invalidated cache to catch up with
+ * @param rules Matching time per rule, by index. Only SYNTAX_ENGINE_REGEX matches
+ *              rule by rule; the combined engine's time is only counted in @p update.
+ */
+struct HighlightPerfStats {
+    LatencyHistogram update;
+    std::vector<LatencyHistogram> rules;
+};
+
+/**
+ * Called when a rule ran out of its match budget and was skipped
+ * @param rule The rule, as compiled into the grammar
+ * @param text The text it was searching
+ */
+using BudgetExceededFunc = std::function<void(const SyntaxRule& rule, const wxString& text)>;
+
+/**
+ * Applies syntax rules to a text and caches the matches between edits
+ *
+ * Edits reported through NoteEdit() are accumulated into a dirty range. The next
+ * Update() re-lexes only a window around that range, growing the window until the
+ * matches at its edges agree with the cached ones, and splices the result back in.
+ * Rules keep their first-match-wins priority.
+ *
+ * Matches refer to a palette of up to 256 styles. Rules with a fixed style cost no
+ * callback and no allocation per match; colors returned by a ColorFunc are added to
+ * the palette on first use, and map to STYLE_DEFAULT once it is full. With the combined
+ * engine, capture groups are only resolved for the matches of rules that use them.
+ *
+ * Each rule gets a time budget per Update(). A rule that exceeds it is abandoned and
+ * its text left in the default style; it is then skipped for twice as many updates
+ * each time it fails again, and runs normally again once it finishes within the
+ * budget. The combined engine gets the same budget for all rules at once; when it runs
+ * out, the rules are matched one by one instead, with the same back-off before the
+ * combined automaton is tried again.
+ *
+ * Rules are matched by an automaton of their own, which checks the budget while it
+ * scans. Only rules the automaton cannot match, such as those with back-references,
+ * lookaround or lazy quantifiers, run on std::regex, where the budget is checked
+ * between matches: a single search that backtracks or finds nothing is not cut short.
+ */
+class SyntaxHighlighter {
+public:
+    SyntaxHighlighter();
+    
+    /**
+     * Highlights with a compiled, shared grammar, replacing the rules, the engine and
+     * the palette. Rules added afterwards go to a private copy of the grammar.
+     */
+    void SetGrammar(SyntaxGrammarPtr grammar);
+    /** @return The grammar in use, compiling the rules added since it was set first */
+    SyntaxGrammarPtr GetGrammar();
+    
+    void AddRule(const std::string& regexPattern, ColorFunc colorFunc);
+    /** Adds a rule that draws every match with the palette entry @p style */
+    void AddRule(const std::string& regexPattern, StyleId style);
+    /** Adds a rule whose function picks the style of each match from a view of its text */
+    void AddRule(const std::string& regexPattern, StyleFunc styleFunc);
+    /** Adds a rule that styles capture groups separately, see SyntaxGrammar::AddRule() */
+    void AddRule(const std::string& regexPattern, const std::vector<GroupStyle>& groupStyles);
+    void ClearRules();
+    
+    /** @return The id of the new palette entry, or STYLE_DEFAULT if all 256 are in use */
+    StyleId AddStyle(const TextStyle& style);
+    /** Changes an existing palette entry. Highlighted runs keep their ids, so nothing is re-lexed. */
+    void SetStyle(StyleId id, const TextStyle& style);
+    const TextStyle& GetStyle(StyleId id) const { return m_styles[id]; }
+    const std::vector<TextStyle>& GetStyles() const { return m_styles; }
+    
+    /**
+     * Selects the matching engine. SYNTAX_ENGINE_COMBINED falls back to matching rule
+     * by rule while any rule uses syntax the combined lexer does not support, and for
+     * a while after it runs out of the match budget.
+     */
+    void SetEngine(SyntaxEngine engine);
+    SyntaxEngine GetEngine() const { return m_draft ? m_draft->GetEngine() : m_grammar->GetEngine(); }
+    
+    /**
+     * Records that @p removed characters at @p pos were replaced by @p inserted characters
+     */
+    void NoteEdit(size_t pos, size_t removed, size_t inserted);
+    void Invalidate() { m_valid = false; }
+    bool IsUpToDate() const { return m_valid && !m_dirty; }
+    
+    /**
+     * Brings the cached matches up to date with @p text
+     *
+     * Text highlighted from scratch is looked up in a process-wide cache first, keyed
+     * by the grammar and the text, so controls sharing a grammar and a value only
+     * tokenize it once; see SetResultCaching().
+     * @return The matched runs, sorted by position and non-overlapping
+     */
+    const std::vector<StyledSegment>& Update(TextBuffer& text);
+    /** Same as above, for text that is not kept in a TextBuffer */
+    const std::vector<StyledSegment>& Update(const wxString& text);
+    
+    /** Turns the process-wide result cache on or off for this highlighter, e.g. to time lexing */
+    void SetResultCaching(bool enable) { m_resultCaching = enable; }
+    bool IsResultCaching() const { return m_resultCaching; }
+    
+    /** Sets the time each rule may take per update, 0 for no limit. Suspended rules resume. */
+    void SetMatchBudget(int milliseconds) {
+        m_matchBudget = milliseconds;
+        m_ruleBudgets.clear();
+        m_lexerBudget = RuleBudget{0, 1};
+    }
+    int GetMatchBudget() const { return m_matchBudget; }
+    /** Sets a function told about every rule that exceeds the match budget */
+    void SetBudgetExceededFunction(BudgetExceededFunc func) { m_budgetExceededFunc = func; }
+    const BudgetExceededFunc& GetBudgetExceededFunction() const { return m_budgetExceededFunc; }
+    
+    /** Records timings into @p stats from now on, or stops recording if it is null */
+    void SetPerfStats(HighlightPerfStats* stats) { m_perfStats = stats; }
+    
+    /** Appends a run to @p segments, splitting it at STYLED_SEGMENT_MAX_LENGTH */
+    static void AppendSegment(std::vector<StyledSegment>& segments, size_t start, size_t length, StyleId style);
+    
+private:
+    SyntaxGrammarPtr m_grammar;
+    std::unique_ptr<SyntaxGrammar> m_draft;  // Rules edited since the grammar was last compiled
+    std::vector<TextStyle> m_styles;
+    std::unordered_map<uint32_t, StyleId> m_colorStyles;  // Palette entries added for ColorFunc results, by RGBA
+    std::wcmatch m_groups;           // Reused for capture groups, so their storage is allocated once
+    std::vector<int> m_groupPaint;   // Style per character of a match with group styles, -1 for none
+    std::vector<StyledSegment> m_tokens;
+    bool m_valid;
+    bool m_resultCaching;
+    
+    // Edited region since the last Update(), in current text coordinates
+    bool m_dirty;
+    size_t m_dirtyStart;
+    size_t m_dirtyEnd;
+    long m_dirtyDelta;  // Net change in text length
+    
+    HighlightPerfStats* m_perfStats;
+    
+    // Rules that exceeded the match budget
+    struct RuleBudget {
+        uint64_t resumeAt;  // The first update the rule runs in again
+        unsigned penalty;   // Updates it is skipped for when it next fails: 1, 2, 4 ... 64
+    };
+    int m_matchBudget;
+    BudgetExceededFunc m_budgetExceededFunc;
+    std::vector<RuleBudget> m_ruleBudgets;
+    RuleBudget m_lexerBudget;  // For all rules at once with the combined engine
+    std::vector<std::pair<size_t, size_t>> m_ruleMatches;  // Ranges claimed by the rule being run
+    uint64_t m_revision;  // Number of updates that lexed
+    bool m_incomplete;    // A rule was skipped, so the tokens must not be reused as they are
+    
+    SyntaxGrammar& EditGrammar();
+    void Lex(TextBuffer& text, size_t from, size_t to,
+             std::vector<StyledSegment>& tokens);
+    StyleId GetColorStyle(const wxColour& color);
+    bool IsRuleSuspended(size_t rule) const;
+    void SuspendRule(size_t rule, const wchar_t* text, size_t length);
+    void Suspend(RuleBudget& budget);
+    void AddMatch(const SyntaxRule& rule, const SyntaxMatch& match, std::vector<StyledSegment>& tokens);
+    bool MatchesCached(const std::vector<StyledSegment>& window, size_t first, size_t last,
+                       size_t from, size_t to, long delta) const;
+};
+
+#endif // SYNTAX_HIGHLIGHTER_H
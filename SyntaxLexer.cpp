@@ -0,0 +1,875 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "SyntaxLexer.h"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <cwchar>
+
+namespace {
+
+const unsigned MAX_CHAR = WCHAR_MAX > 0xFFFF ? 0x10FFFF : 0xFFFF;
+const int MAX_REPEAT = 1000;
+const size_t MAX_NFA_STATES = 20000;
+const size_t MAX_DFA_STATES = 4096;
+
+// Scan() reads the clock once every this many + 1 automaton steps
+const size_t DEADLINE_CHECK_MASK = 0xFFF;
+
+// Inclusive code point ranges, sorted and non-overlapping once normalized
+typedef std::pair<unsigned, unsigned> CharRange;
+typedef std::vector<CharRange> CharSet;
+
+enum Assertion {
+    ASSERT_WORD_BOUNDARY,
+    ASSERT_NOT_WORD_BOUNDARY,
+    ASSERT_BEGIN,
+    ASSERT_END
+};
+
+CharSet Normalize(CharSet set) {
+    std::sort(set.begin(), set.end());
+    CharSet result;
+    for (const auto& range : set) {
+        if (!result.empty() && range.first <= result.back().second + 1) {
+            result.back().second = std::max(result.back().second, range.second);
+        } else {
+            result.push_back(range);
+        }
+    }
+    return result;
+}
+
+CharSet Complement(const CharSet& set) {
+    CharSet normalized = Normalize(set);
+    CharSet result;
+    unsigned next = 0;
+    for (const auto& range : normalized) {
+        if (range.first > next) {
+            result.push_back(CharRange(next, range.first - 1));
+        }
+        next = range.second + 1;
+    }
+    if (next <= MAX_CHAR) {
+        result.push_back(CharRange(next, MAX_CHAR));
+    }
+    return result;
+}
+
+bool Contains(const CharSet& set, unsigned c) {
+    auto it = std::upper_bound(set.begin(), set.end(), CharRange(c, MAX_CHAR));
+    return it != set.begin() && (it - 1)->second >= c;
+}
+
+CharSet WordChars() {
+    return {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+}
+
+CharSet DigitChars() {
+    return {{'0', '9'}};
+}
+
+CharSet SpaceChars() {
+    return {{0x09, 0x0D}, {0x20, 0x20}, {0xA0, 0xA0}, {0x1680, 0x1680}, {0x2000, 0x200A},
+            {0x2028, 0x2029}, {0x202F, 0x202F}, {0x205F, 0x205F}, {0x3000, 0x3000}, {0xFEFF, 0xFEFF}};
+}
+
+CharSet AnyButLineTerminator() {
+    return Complement({{'\n', '\n'}, {'\r', '\r'}, {0x2028, 0x2029}});
+}
+
+struct Node {
+    enum Kind { EMPTY, SET, CONCAT, ALTERNATE, REPEAT, ASSERT } kind;
+    CharSet set;
+    std::vector<int> children;
+    int min;
+    int max;  // -1 when unbounded
+    Assertion assertion;
+};
+
+// Recursive descent parser for the supported ECMAScript subset
+class Parser {
+public:
+    Parser(const std::wstring& pattern, std::vector<Node>& nodes)
+        : m_pattern(pattern), m_nodes(nodes), m_pos(0), m_ok(true) {}
+
+    bool Parse(int& root) {
+        root = ParseAlternation();
+        return m_ok && m_pos == m_pattern.length();
+    }
+
+private:
+    const std::wstring& m_pattern;
+    std::vector<Node>& m_nodes;
+    size_t m_pos;
+    bool m_ok;
+
+    bool AtEnd() const { return m_pos >= m_pattern.length(); }
+    wchar_t Peek() const { return m_pattern[m_pos]; }
+
+    int Fail() {
+        m_ok = false;
+        return -1;
+    }
+
+    int Add(Node::Kind kind) {
+        Node node;
+        node.kind = kind;
+        node.min = 0;
+        node.max = 0;
+        node.assertion = ASSERT_BEGIN;
+        m_nodes.push_back(node);
+        return (int)m_nodes.size() - 1;
+    }
+
+    int AddSet(const CharSet& set) {
+        int node = Add(Node::SET);
+        m_nodes[node].set = Normalize(set);
+        return node;
+    }
+
+    int AddAssertion(Assertion assertion) {
+        int node = Add(Node::ASSERT);
+        m_nodes[node].assertion = assertion;
+        return node;
+    }
+
+    int ParseAlternation() {
+        std::vector<int> branches;
+        branches.push_back(ParseConcat());
+        while (m_ok && !AtEnd() && Peek() == '|') {
+            m_pos++;
+            branches.push_back(ParseConcat());
+        }
+        if (!m_ok) return -1;
+        if (branches.size() == 1) return branches[0];
+
+        int node = Add(Node::ALTERNATE);
+        m_nodes[node].children = branches;
+        return node;
+    }
+
+    int ParseConcat() {
+        std::vector<int> items;
+        while (m_ok && !AtEnd() && Peek() != '|' && Peek() != ')') {
+            items.push_back(ParseRepeat());
+        }
+        if (!m_ok) return -1;
+        if (items.empty()) return Add(Node::EMPTY);
+        if (items.size() == 1) return items[0];
+
+        int node = Add(Node::CONCAT);
+        m_nodes[node].children = items;
+        return node;
+    }
+
+    bool ParseNumber(int& value) {
+        size_t start = m_pos;
+        value = 0;
+        while (!AtEnd() && Peek() >= '0' && Peek() <= '9') {
+            value = std::min(value * 10 + (Peek() - '0'), MAX_REPEAT + 1);
+            m_pos++;
+        }
+        return m_pos > start;
+    }
+
+    int ParseRepeat() {
+        int atom = ParseAtom();
+        if (!m_ok || AtEnd()) return atom;
+
+        int min, max;
+        switch (Peek()) {
+            case '*': min = 0; max = -1; m_pos++; break;
+            case '+': min = 1; max = -1; m_pos++; break;
+            case '?': min = 0; max = 1; m_pos++; break;
+            case '{':
+                m_pos++;
+                if (!ParseNumber(min)) return Fail();
+                max = min;
+                if (!AtEnd() && Peek() == ',') {
+                    m_pos++;
+                    if (!ParseNumber(max)) max = -1;
+                }
+                if (AtEnd() || Peek() != '}') return Fail();
+                m_pos++;
+                if (min > MAX_REPEAT || max > MAX_REPEAT || (max != -1 && max < min)) return Fail();
+                break;
+            default:
+                return atom;
+        }
+
+        // Lazy or stacked quantifiers are not supported
+        if (!AtEnd() && (Peek() == '?' || Peek() == '*' || Peek() == '+' || Peek() == '{')) {
+            return Fail();
+        }
+        if (m_nodes[atom].kind == Node::ASSERT) {
+            return Fail();
+        }
+
+        int node = Add(Node::REPEAT);
+        m_nodes[node].children.push_back(atom);
+        m_nodes[node].min = min;
+        m_nodes[node].max = max;
+        return node;
+    }
+
+    int ParseAtom() {
+        wchar_t c = Peek();
+        m_pos++;
+
+        switch (c) {
+            case '(': {
+                if (!AtEnd() && Peek() == '?') {
+                    // Only non-capturing groups, no lookaround
+                    if (m_pos + 1 >= m_pattern.length() || m_pattern[m_pos + 1] != ':') return Fail();
+                    m_pos += 2;
+                }
+                int inner = ParseAlternation();
+                if (!m_ok || AtEnd() || Peek() != ')') return Fail();
+                m_pos++;
+                return inner;
+            }
+            case '[': {
+                CharSet set;
+                if (!ParseClass(set)) return Fail();
+                return AddSet(set);
+            }
+            case '.':
+                return AddSet(AnyButLineTerminator());
+            case '^':
+                return AddAssertion(ASSERT_BEGIN);
+            case '$':
+                return AddAssertion(ASSERT_END);
+            case '\\': {
+                if (AtEnd()) return Fail();
+                if (Peek() == 'b') { m_pos++; return AddAssertion(ASSERT_WORD_BOUNDARY); }
+                if (Peek() == 'B') { m_pos++; return AddAssertion(ASSERT_NOT_WORD_BOUNDARY); }
+                CharSet set;
+                if (!ParseEscape(set, false)) return Fail();
+                return AddSet(set);
+            }
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                return Fail();
+            default:
+                return AddSet({{(unsigned)c, (unsigned)c}});
+        }
+    }
+
+    bool ParseHex(size_t digits, unsigned& value) {
+        value = 0;
+        for (size_t i = 0; i < digits; i++) {
+            if (AtEnd()) return false;
+            wchar_t c = Peek();
+            unsigned digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return false;
+            value = value * 16 + digit;
+            m_pos++;
+        }
+        return true;
+    }
+
+    // Parses the escape after a backslash into a set. Classes such as \d yield several ranges.
+    bool ParseEscape(CharSet& set, bool inClass) {
+        wchar_t c = Peek();
+        m_pos++;
+        unsigned value;
+
+        switch (c) {
+            case 'd': set = DigitChars(); return true;
+            case 'D': set = Complement(DigitChars()); return true;
+            case 'w': set = WordChars(); return true;
+            case 'W': set = Complement(WordChars()); return true;
+            case 's': set = SpaceChars(); return true;
+            case 'S': set = Complement(SpaceChars()); return true;
+            case 'n': value = '\n'; break;
+            case 'r': value = '\r'; break;
+            case 't': value = '\t'; break;
+            case 'f': value = '\f'; break;
+            case 'v': value = '\v'; break;
+            case 'b':
+                if (!inClass) return false;
+                value = '\b';
+                break;
+            case '0':
+                if (!AtEnd() && Peek() >= '0' && Peek() <= '9') return false;
+                value = 0;
+                break;
+            case 'x':
+                if (!ParseHex(2, value)) return false;
+                break;
+            case 'u':
+                if (!ParseHex(4, value)) return false;
+                break;
+            case 'c':
+                if (AtEnd() || !((Peek() >= 'a' && Peek() <= 'z') || (Peek() >= 'A' && Peek() <= 'Z'))) return false;
+                value = Peek() % 32;
+                m_pos++;
+                break;
+            default:
+                // Back-references are not supported
+                if (c >= '1' && c <= '9') return false;
+                if (c == 'B') return false;
+                value = (unsigned)c;
+                break;
+        }
+
+        set = {{value, value}};
+        return true;
+    }
+
+    bool ParseClassAtom(CharSet& set) {
+        if (AtEnd()) return false;
+        wchar_t c = Peek();
+        m_pos++;
+        if (c == '\\') {
+            return !AtEnd() && ParseEscape(set, true);
+        }
+        set = {{(unsigned)c, (unsigned)c}};
+        return true;
+    }
+
+    bool ParseClass(CharSet& set) {
+        bool negate = false;
+        if (!AtEnd() && Peek() == '^') {
+            negate = true;
+            m_pos++;
+        }
+
+        while (!AtEnd() && Peek() != ']') {
+            CharSet first;
+            if (!ParseClassAtom(first)) return false;
+
+            if (m_pos + 1 < m_pattern.length() && Peek() == '-' && m_pattern[m_pos + 1] != ']') {
+                m_pos++;
+                CharSet last;
+                if (!ParseClassAtom(last)) return false;
+                if (first.size() != 1 || last.size() != 1 ||
+                    first[0].first != first[0].second || last[0].first != last[0].second ||
+                    first[0].first > last[0].first) {
+                    return false;
+                }
+                set.push_back(CharRange(first[0].first, last[0].first));
+            } else {
+                set.insert(set.end(), first.begin(), first.end());
+            }
+        }
+
+        if (AtEnd()) return false;
+        m_pos++;
+
+        set = negate ? Complement(set) : Normalize(set);
+        return true;
+    }
+};
+
+// Thompson NFA over all rules
+struct NfaState {
+    enum Kind { SET, SPLIT, ASSERT, ACCEPT } kind;
+    int next;
+    int alt;          // Second branch of a SPLIT, -1 for a plain epsilon move
+    size_t set;       // Index into the set list for SET states
+    Assertion assertion;
+    size_t rule;
+};
+
+class NfaBuilder {
+public:
+    NfaBuilder(const std::vector<Node>& nodes, std::vector<NfaState>& states, std::vector<CharSet>& sets)
+        : m_nodes(nodes), m_states(states), m_sets(sets), m_rule(0) {}
+
+    int BuildRule(int root, size_t rule) {
+        m_rule = rule;
+        int accept = Add(NfaState::ACCEPT);
+        return Build(root, accept);
+    }
+
+    bool Overflowed() const { return m_states.size() > MAX_NFA_STATES; }
+
+private:
+    const std::vector<Node>& m_nodes;
+    std::vector<NfaState>& m_states;
+    std::vector<CharSet>& m_sets;
+    size_t m_rule;
+
+    int Add(NfaState::Kind kind, int next = -1, int alt = -1) {
+        NfaState state;
+        state.kind = kind;
+        state.next = next;
+        state.alt = alt;
+        state.set = 0;
+        state.assertion = ASSERT_BEGIN;
+        state.rule = m_rule;
+        m_states.push_back(state);
+        return (int)m_states.size() - 1;
+    }
+
+    // Builds the fragment for a node so that it continues into `out`, returning its entry
+    int Build(int index, int out) {
+        if (Overflowed()) return out;
+
+        const Node& node = m_nodes[index];
+        switch (node.kind) {
+            case Node::EMPTY:
+                return out;
+            case Node::SET: {
+                int state = Add(NfaState::SET, out);
+                m_states[state].set = m_sets.size();
+                m_sets.push_back(node.set);
+                return state;
+            }
+            case Node::ASSERT: {
+                int state = Add(NfaState::ASSERT, out);
+                m_states[state].assertion = node.assertion;
+                return state;
+            }
+            case Node::CONCAT:
+                for (size_t i = node.children.size(); i-- > 0;) {
+                    out = Build(node.children[i], out);
+                }
+                return out;
+            case Node::ALTERNATE: {
+                int entry = Build(node.children.back(), out);
+                for (size_t i = node.children.size() - 1; i-- > 0;) {
+                    int branch = Build(node.children[i], out);
+                    entry = Add(NfaState::SPLIT, branch, entry);
+                }
+                return entry;
+            }
+            case Node::REPEAT: {
+                int child = node.children[0];
+                int entry = out;
+                if (node.max == -1) {
+                    int loop = Add(NfaState::SPLIT, -1, out);
+                    int body = Build(child, loop);
+                    m_states[loop].next = body;
+                    entry = loop;
+                } else {
+                    for (int i = node.min; i < node.max; i++) {
+                        int body = Build(child, entry);
+                        entry = Add(NfaState::SPLIT, body, out);
+                    }
+                }
+                for (int i = 0; i < node.min; i++) {
+                    entry = Build(child, entry);
+                }
+                return entry;
+            }
+        }
+        return out;
+    }
+};
+
+struct ClosureContext {
+    bool prevWord;
+    bool nextWord;
+    bool atStart;
+    bool atEnd;
+};
+
+// Follows epsilon moves and satisfied assertions, collecting SET and ACCEPT states
+void Closure(const std::vector<NfaState>& states, const std::vector<int>& kernel,
+             const ClosureContext& context, std::vector<int>& result,
+             std::vector<unsigned>& visited, unsigned& stamp) {
+    stamp++;
+    result.clear();
+    std::vector<int> stack(kernel.rbegin(), kernel.rend());
+
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        if (index < 0 || visited[index] == stamp) continue;
+        visited[index] = stamp;
+
+        const NfaState& state = states[index];
+        switch (state.kind) {
+            case NfaState::SET:
+            case NfaState::ACCEPT:
+                result.push_back(index);
+                break;
+            case NfaState::SPLIT:
+                stack.push_back(state.alt);
+                stack.push_back(state.next);
+                break;
+            case NfaState::ASSERT: {
+                bool holds = false;
+                switch (state.assertion) {
+                    case ASSERT_WORD_BOUNDARY: holds = context.prevWord != context.nextWord; break;
+                    case ASSERT_NOT_WORD_BOUNDARY: holds = context.prevWord == context.nextWord; break;
+                    case ASSERT_BEGIN: holds = context.atStart; break;
+                    case ASSERT_END: holds = context.atEnd; break;
+                }
+                if (holds) stack.push_back(state.next);
+                break;
+            }
+        }
+    }
+}
+
+} // namespace
+
+SyntaxLexer::SyntaxLexer() : m_compiled(false), m_ruleCount(0) {
+    Clear();
+}
+
+void SyntaxLexer::Clear() {
+    m_compiled = false;
+    m_ruleCount = 0;
+    m_states.clear();
+    m_classStarts.clear();
+    m_classIsWord.clear();
+    m_asciiClass.clear();
+    for (auto& row : m_startStates) {
+        row[0] = row[1] = -1;
+    }
+}
+
+bool SyntaxLexer::Compile(const std::vector<std::wstring>& patterns) {
+    Clear();
+
+    // Parse every rule and build one NFA with a start state per rule
+    std::vector<NfaState> nfa;
+    std::vector<CharSet> sets;
+    std::vector<int> ruleStarts;
+    for (size_t rule = 0; rule < patterns.size(); rule++) {
+        std::vector<Node> nodes;
+        Parser parser(patterns[rule], nodes);
+        int root;
+        if (!parser.Parse(root)) {
+            return false;
+        }
+        NfaBuilder builder(nodes, nfa, sets);
+        ruleStarts.push_back(builder.BuildRule(root, rule));
+        if (builder.Overflowed()) {
+            return false;
+        }
+    }
+
+    // Split the code points into classes that no set or word boundary distinguishes
+    std::vector<unsigned> cuts = {0};
+    CharSet word = WordChars();
+    for (const auto& range : word) {
+        cuts.push_back(range.first);
+        cuts.push_back(range.second + 1);
+    }
+    for (const auto& set : sets) {
+        for (const auto& range : set) {
+            cuts.push_back(range.first);
+            cuts.push_back(range.second + 1);
+        }
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    while (!cuts.empty() && cuts.back() > MAX_CHAR) {
+        cuts.pop_back();
+    }
+    m_classStarts = cuts;
+    size_t classCount = m_classStarts.size();
+
+    for (size_t i = 0; i < classCount; i++) {
+        m_classIsWord.push_back(Contains(word, m_classStarts[i]));
+    }
+    std::vector<std::vector<bool>> setHasClass(sets.size(), std::vector<bool>(classCount));
+    for (size_t s = 0; s < sets.size(); s++) {
+        for (size_t i = 0; i < classCount; i++) {
+            setHasClass[s][i] = Contains(sets[s], m_classStarts[i]);
+        }
+    }
+    m_asciiClass.resize(128);
+    for (unsigned c = 0; c < 128; c++) {
+        m_asciiClass[c] = (int)(std::upper_bound(m_classStarts.begin(), m_classStarts.end(), c) - m_classStarts.begin()) - 1;
+    }
+
+    // Subset construction. A DFA state is a set of NFA states together with the
+    // context that assertions need: whether the previous character was a word
+    // character and whether we are at the start of the text.
+    std::map<std::vector<int>, int> known;
+    std::vector<std::vector<int>> kernels;
+    auto intern = [&](std::vector<int> kernel, bool prevWord, bool atStart) -> int {
+        if (kernel.empty()) return -1;
+        std::sort(kernel.begin(), kernel.end());
+        kernel.erase(std::unique(kernel.begin(), kernel.end()), kernel.end());
+        kernel.push_back(prevWord);
+        kernel.push_back(atStart);
+        auto it = known.find(kernel);
+        if (it != known.end()) return it->second;
+        int id = (int)kernels.size();
+        known[kernel] = id;
+        kernels.push_back(kernel);
+        return id;
+    };
+
+    for (int prevWord = 0; prevWord < 2; prevWord++) {
+        for (int atStart = 0; atStart < 2; atStart++) {
+            m_startStates[prevWord][atStart] = intern(ruleStarts, prevWord != 0, atStart != 0);
+        }
+    }
+
+    std::vector<unsigned> visited(nfa.size(), 0);
+    unsigned stamp = 0;
+    std::vector<int> closure[NEXT_CONTEXTS];
+
+    for (size_t id = 0; id < kernels.size(); id++) {
+        if (kernels.size() > MAX_DFA_STATES) {
+            Clear();
+            return false;
+        }
+
+        std::vector<int> kernel(kernels[id].begin(), kernels[id].end() - 2);
+        bool prevWord = kernels[id][kernel.size()] != 0;
+        bool atStart = kernels[id][kernel.size() + 1] != 0;
+
+        Closure(nfa, kernel, {prevWord, true, atStart, false}, closure[NEXT_WORD], visited, stamp);
+        Closure(nfa, kernel, {prevWord, false, atStart, false}, closure[NEXT_OTHER], visited, stamp);
+        Closure(nfa, kernel, {prevWord, false, atStart, true}, closure[NEXT_END], visited, stamp);
+
+        State state;
+        for (int context = 0; context < NEXT_CONTEXTS; context++) {
+            for (int index : closure[context]) {
+                if (nfa[index].kind == NfaState::ACCEPT) {
+                    state.accepts[context].push_back(nfa[index].rule);
+                } else if (context != NEXT_END) {
+                    state.live.push_back(nfa[index].rule);
+                }
+            }
+            std::sort(state.accepts[context].begin(), state.accepts[context].end());
+            state.accepts[context].erase(std::unique(state.accepts[context].begin(), state.accepts[context].end()),
+                                         state.accepts[context].end());
+            state.acceptMask[context] = 0;
+            for (size_t rule : state.accepts[context]) {
+                state.acceptMask[context] |= GetRuleBit(rule);
+            }
+        }
+        std::sort(state.live.begin(), state.live.end());
+        state.live.erase(std::unique(state.live.begin(), state.live.end()), state.live.end());
+
+        state.next.resize(classCount);
+        for (size_t c = 0; c < classCount; c++) {
+            const std::vector<int>& from = closure[m_classIsWord[c] ? NEXT_WORD : NEXT_OTHER];
+            std::vector<int> target;
+            for (int index : from) {
+                if (nfa[index].kind == NfaState::SET && setHasClass[nfa[index].set][c]) {
+                    target.push_back(nfa[index].next);
+                }
+            }
+            state.next[c] = intern(target, m_classIsWord[c], false);
+        }
+        m_states.push_back(state);
+    }
+
+    m_ruleCount = patterns.size();
+    m_compiled = true;
+    return true;
+}
+
+int SyntaxLexer::GetClass(wchar_t c) const {
+    unsigned code = (unsigned)c;
+    if (code < 128) {
+        return m_asciiClass[code];
+    }
+    return (int)(std::upper_bound(m_classStarts.begin(), m_classStarts.end(), code) - m_classStarts.begin()) - 1;
+}
+
+bool SyntaxLexer::Scan(const wchar_t* text, size_t length, size_t from, std::vector<SyntaxToken>& tokens,
+                       const std::chrono::steady_clock::time_point* deadline) const {
+    if (!m_compiled || m_ruleCount == 0) {
+        return true;
+    }
+
+    const size_t NONE = (size_t)-1;
+
+    // Mirror one std::regex iteration per rule: each rule resumes searching where its
+    // previous match ended, and takes the longest match at the first position it can
+    std::vector<size_t> resume(m_ruleCount, from);
+    std::vector<size_t> matchEnd(m_ruleCount, NONE);
+    std::vector<size_t> matchedRules;
+    std::vector<std::vector<std::pair<size_t, size_t>>> matches(m_ruleCount);
+    size_t steps = 0;
+
+    // The run ahead from a state at a position is the same whichever start it came from.
+    // Each position remembers the state the latest finished run was in there and which
+    // rules accepted from there on. A later run that reaches that state at that position
+    // stops unless one of those rules is due, so an unterminated delimiter is read
+    // through once rather than once per start position.
+    std::vector<int> seenState(length + 1, -1);
+    std::vector<RuleMask> seenAccepts(length + 1, 0);
+    struct Step {
+        size_t end;
+        int state;
+        RuleMask accepts;
+    };
+    std::vector<Step> trail;
+
+    for (size_t pos = from; pos < length; pos++) {
+        bool prevWord = pos > 0 && m_classIsWord[GetClass(text[pos - 1])];
+        int state = m_startStates[prevWord][pos == 0];
+        int cls = GetClass(text[pos]);
+        
+        RuleMask dueRules = 0;
+        for (size_t rule = 0; rule < m_ruleCount; rule++) {
+            if (resume[rule] <= pos) dueRules |= GetRuleBit(rule);
+        }
+        bool exhausted = true;  // The run ended because nothing further can match
+        RuleMask tailAccepts = 0;
+        trail.clear();
+
+        for (size_t i = pos; i < length && state >= 0; i++) {
+            if (deadline && (++steps & DEADLINE_CHECK_MASK) == 0 && std::chrono::steady_clock::now() > *deadline) {
+                return false;
+            }
+            
+            state = m_states[state].next[cls];
+            if (state < 0) break;
+            if (seenState[i + 1] == state && (seenAccepts[i + 1] & dueRules) == 0) {
+                tailAccepts = seenAccepts[i + 1];
+                break;
+            }
+
+            const State& current = m_states[state];
+            NextContext context = NEXT_END;
+            if (i + 1 < length) {
+                cls = GetClass(text[i + 1]);
+                context = m_classIsWord[cls] ? NEXT_WORD : NEXT_OTHER;
+            }
+            trail.push_back({i + 1, state, current.acceptMask[context]});
+
+            for (size_t rule : current.accepts[context]) {
+                if (resume[rule] > pos) continue;
+                if (matchEnd[rule] == NONE) matchedRules.push_back(rule);
+                matchEnd[rule] = i + 1;
+            }
+
+            // Stop once no rule that is due at this position can extend its match
+            bool due = false;
+            for (size_t rule : current.live) {
+                if (resume[rule] <= pos) {
+                    due = true;
+                    break;
+                }
+            }
+            if (!due) {
+                exhausted = false;
+                break;
+            }
+        }
+
+        if (exhausted) {
+            for (auto step = trail.rbegin(); step != trail.rend(); ++step) {
+                tailAccepts |= step->accepts;
+                seenState[step->end] = step->state;
+                seenAccepts[step->end] = tailAccepts;
+            }
+        }
+
+        for (size_t rule : matchedRules) {
+            matches[rule].push_back(std::make_pair(pos, matchEnd[rule]));
+            resume[rule] = matchEnd[rule];
+            matchEnd[rule] = NONE;
+        }
+        matchedRules.clear();
+    }
+
+    // First match wins: earlier rules claim their runs before later ones
+    std::map<size_t, std::pair<size_t, size_t>> claimed;  // start -> (end, rule)
+    for (size_t rule = 0; rule < m_ruleCount; rule++) {
+        for (const auto& match : matches[rule]) {
+            auto next = claimed.lower_bound(match.first);
+            if (next != claimed.end() && next->first < match.second) continue;
+            if (next != claimed.begin() && std::prev(next)->second.first > match.first) continue;
+            claimed.insert(next, std::make_pair(match.first, std::make_pair(match.second, rule)));
+        }
+    }
+
+    for (const auto& entry : claimed) {
+        tokens.push_back({entry.first, entry.second.first - entry.first, entry.second.second});
+    }
+    return true;
+}
+
+bool SyntaxLexer::IsBacktrackProne(const std::wstring& pattern) {
+    // Per open group, whether it contains an unbounded quantifier; the bottom entry is
+    // the pattern itself
+    std::vector<bool> quantified(1, false);
+    bool atomQuantified = false;  // The atom before the current character is such a group
+    
+    for (size_t i = 0; i < pattern.length(); i++) {
+        wchar_t c = pattern[i];
+        bool unbounded = c == L'*' || c == L'+';
+        
+        if (c == L'{') {
+            size_t close = pattern.find(L'}', i);
+            if (close == std::wstring::npos) {
+                atomQuantified = false;
+                continue;
+            }
+            unbounded = pattern[close - 1] == L',';
+            i = close;
+        }
+        
+        if (unbounded) {
+            if (atomQuantified) {
+                return true;
+            }
+            quantified.back() = true;
+            atomQuantified = false;
+        }
+        else if (c == L'(') {
+            quantified.push_back(false);
+            atomQuantified = false;
+        }
+        else if (c == L')' && quantified.size() > 1) {
+            atomQuantified = quantified.back();
+            quantified.pop_back();
+            if (atomQuantified) {
+                quantified.back() = true;
+            }
+        }
+        else if (c == L'?' || c == L'{') {
+            // Lazy or bounded, the quantified atom stays as it was
+        }
+        else {
+            if (c == L'\\') {
+                i++;
+            }
+            else if (c == L'[') {
+                // A ] right after [ or [^ is a literal
+                size_t end = i + 1;
+                if (end < pattern.length() && pattern[end] == L'^') end++;
+                if (end < pattern.length() && pattern[end] == L']') end++;
+                while (end < pattern.length() && pattern[end] != L']') {
+                    end += pattern[end] == L'\\' ? 2 : 1;
+                }
+                i = end;
+            }
+            atomQuantified = false;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SYNTAX_LEXER_H
+#define SYNTAX_LEXER_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A run of text claimed by one rule
+ * @param start The position of the first character
+ * @param length The number of characters
+ * @param rule The index of the rule that matched
+ */
+struct SyntaxToken {
+    size_t start;
+    size_t length;
+    size_t rule;
+};
+
+/**
+ * Combined automaton for a list of highlighting patterns
+ *
+ * All patterns are compiled into a single DFA, so text is classified by one walk over
+ * the start positions instead of one regex search per rule. The DFA is restarted at
+ * every start position and runs ahead while any rule can still match, but a run stops
+ * where an earlier one reached the same state at the same position and found nothing
+ * further for the rules still looking for a match. A rule like "[^"]*" over text with
+ * an unterminated quote, or (a+)+b over a run of a, is then read through once rather
+ * than once per start position. The bound is not strictly linear, since only the
+ * latest such state is kept per position, so Scan() also takes a deadline.
+ *
+ * The result is the same as running each pattern with std::regex and letting earlier
+ * rules win overlaps, with two differences: each rule takes its longest match at a
+ * position (ECMAScript would prefer the first alternative that matches), and \\w, \\d
+ * and \\s use their ASCII/ECMAScript definitions rather than the current locale.
+ *
+ * Supported syntax is the ECMAScript subset without back-references, lookaround and
+ * lazy quantifiers. Compile() reports anything else so the caller can fall back to
+ * std::regex. A compiled lexer is immutable and may be shared between threads.
+ */
+class SyntaxLexer {
+public:
+    SyntaxLexer();
+
+    /**
+     * Compiles the patterns, in priority order
+     * @return false if a pattern is unsupported or the automaton grows too large
+     */
+    bool Compile(const std::vector<std::wstring>& patterns);
+    bool IsCompiled() const { return m_compiled; }
+    void Clear();
+
+    /**
+     * Classifies text[from, length)
+     *
+     * Characters before @p from are only used as context for anchors such as \\b.
+     * @param tokens Receives the claimed runs, sorted by position
+     * @param deadline When to give up, checked every few thousand characters; null for never
+     * @return false if the deadline passed, in which case no tokens were added
+     */
+    bool Scan(const wchar_t* text, size_t length, size_t from, std::vector<SyntaxToken>& tokens,
+              const std::chrono::steady_clock::time_point* deadline = nullptr) const;
+    
+    /**
+     * Detects nested unbounded quantifiers such as (a+)+ or (\\w+\\s?)*
+     *
+     * std::regex backtracks through every way of splitting the input between the
+     * quantifiers, which takes exponential time on text that almost matches. The
+     * check is syntactic, so it also flags some patterns that would be harmless.
+     */
+    static bool IsBacktrackProne(const std::wstring& pattern);
+
+private:
+    enum NextContext { NEXT_WORD, NEXT_OTHER, NEXT_END, NEXT_CONTEXTS };
+
+    // A set of rules, one bit per rule; rules from the 64th on share the last bit
+    typedef uint64_t RuleMask;
+    static RuleMask GetRuleBit(size_t rule) { return (RuleMask)1 << (rule < 63 ? rule : 63); }
+
+    struct State {
+        std::vector<int> next;                         // Target state per character class, -1 when dead
+        std::vector<size_t> accepts[NEXT_CONTEXTS];    // Rules matching here, by the character that follows
+        RuleMask acceptMask[NEXT_CONTEXTS];            // The same as sets
+        std::vector<size_t> live;                      // Rules that may still match further on
+    };
+
+    bool m_compiled;
+    size_t m_ruleCount;
+    std::vector<State> m_states;
+    int m_startStates[2][2];              // Indexed by [previous char is a word char][at start of text]
+    std::vector<unsigned> m_classStarts;  // First code point of each character class
+    std::vector<bool> m_classIsWord;
+    std::vector<int> m_asciiClass;
+
+    int GetClass(wchar_t c) const;
+};
+
+#endif // SYNTAX_LEXER_H
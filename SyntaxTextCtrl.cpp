@@ -23,11 +23,132 @@
  */
 
 #include "SyntaxTextCtrl.h"
-#include <wx/dcbuffer.h>
+#include <wx/dcmemory.h>
 #include <wx/clipbrd.h>
+#include <wx/weakref.h>
 #include <algorithm>
+#include <cstdlib>
 
-static const int CURSOR_TIMER_ID = wxID_HIGHEST + 1;
+static const int COMPLETION_TIMER_ID = wxID_HIGHEST + 2;
+static const int DRAG_TIMER_ID = wxID_HIGHEST + 3;
+static const int PERF_LOG_TIMER_ID = wxID_HIGHEST + 4;
+
+// Default pause in typing before an asynchronous completion request is made
+static const int DEFAULT_COMPLETION_DELAY = 100;
+
+// Rows shown at once in the completion popup, also the page up/down step
+static const int COMPLETION_VISIBLE_ROWS = 8;
+
+// The rendered line is cached in bitmaps of this many pixels, and far-away ones are
+// dropped once this many are rendered
+static const int LINE_TILE_WIDTH = 512;
+static const size_t MAX_LINE_TILES = 16;
+
+// Drag selection is processed at most once per frame, and autoscrolls by the distance
+// the pointer is past the edge, up to the maximum step per frame
+static const int DRAG_FRAME_INTERVAL = 16;
+static const int MAX_AUTOSCROLL_STEP = 64;
+
+// Characters measured to find the pitch of a fixed-pitch font, enough to keep the
+// rounding error below a pixel across a long line
+static const int PITCH_SAMPLE_LENGTH = 64;
+
+// Half period of the caret blink
+static const int CARET_BLINK_INTERVAL = 500;
+
+/**
+ * Blinks the caret of the focused control
+ *
+ * Only the focused control shows a caret, so all controls share one timer. It stops
+ * while the application is inactive or the control is off screen, and starts again
+ * when the application is activated, the control is shown or painted, regains focus
+ * or its caret moves.
+ */
+class CaretBlinker : public wxTimer {
+public:
+    CaretBlinker() : m_ctrl(nullptr) {
+        wxTheApp->Bind(wxEVT_ACTIVATE_APP, &CaretBlinker::OnActivateApp, this);
+    }
+    
+    ~CaretBlinker() {
+        if (wxTheApp) {
+            wxTheApp->Unbind(wxEVT_ACTIVATE_APP, &CaretBlinker::OnActivateApp, this);
+        }
+    }
+    
+    /** Blinks @p ctrl's caret, starting from the visible phase */
+    void Attach(SyntaxTextCtrl* ctrl) {
+        m_ctrl = ctrl;
+        m_ctrl->m_cursorVisible = true;
+        Start(CARET_BLINK_INTERVAL);
+    }
+    
+    void Detach(SyntaxTextCtrl* ctrl) {
+        if (m_ctrl == ctrl) {
+            Stop();
+            m_ctrl = nullptr;
+        }
+    }
+    
+    /** Restarts the blinking if it stopped while @p ctrl had focus, keeping the phase */
+    void Resume(SyntaxTextCtrl* ctrl) {
+        if (m_ctrl == ctrl && !IsRunning()) {
+            Start(CARET_BLINK_INTERVAL);
+        }
+    }
+    
+    virtual void Notify() override {
+        if (!m_ctrl || !wxTheApp->IsActive() || !m_ctrl->IsShownOnScreen()) {
+            if (m_ctrl && !m_ctrl->m_cursorVisible) {
+                m_ctrl->m_cursorVisible = true;
+                m_ctrl->RefreshRect(m_ctrl->GetCaretRect(), false);
+            }
+            Stop();
+            return;
+        }
+        m_ctrl->m_cursorVisible = !m_ctrl->m_cursorVisible;
+        m_ctrl->RefreshRect(m_ctrl->GetCaretRect(), false);
+    }
+    
+private:
+    SyntaxTextCtrl* m_ctrl;
+    
+    void OnActivateApp(wxActivateEvent& event) {
+        event.Skip();
+        if (event.GetActive() && m_ctrl) {
+            Resume(m_ctrl);
+        }
+    }
+};
+
+// Created with the first control and destroyed with the last one, so no timer
+// outlives the GUI
+static CaretBlinker* s_caretBlinker = nullptr;
+static size_t s_controlCount = 0;
+
+// Parents whose sizers are laid out once the current event has been handled, so
+// changing the font of many controls lays each parent out only once
+static std::vector<wxWeakRef<wxWindow>> s_pendingLayouts;
+
+static void LayoutPendingParents() {
+    std::vector<wxWeakRef<wxWindow>> parents;
+    parents.swap(s_pendingLayouts);
+    for (wxWindow* parent : parents) {
+        if (parent && parent->GetSizer()) {
+            parent->GetSizer()->Layout();
+        }
+    }
+}
+
+static void ScheduleParentLayout(wxWindow* parent) {
+    for (wxWindow* pending : s_pendingLayouts) {
+        if (pending == parent) return;
+    }
+    if (s_pendingLayouts.empty()) {
+        wxTheApp->CallAfter(&LayoutPendingParents);
+    }
+    s_pendingLayouts.push_back(parent);
+}
 
 wxBEGIN_EVENT_TABLE(SyntaxTextCtrl, wxControl)
     EVT_PAINT(SyntaxTextCtrl::OnPaint)
@@ -36,16 +157,126 @@ wxBEGIN_EVENT_TABLE(SyntaxTextCtrl, wxControl)
     EVT_LEFT_DOWN(SyntaxTextCtrl::OnMouseDown)
     EVT_MOTION(SyntaxTextCtrl::OnMouseMove)
     EVT_LEFT_UP(SyntaxTextCtrl::OnMouseUp)
+    EVT_MOUSE_CAPTURE_LOST(SyntaxTextCtrl::OnMouseCaptureLost)
     EVT_SET_FOCUS(SyntaxTextCtrl::OnSetFocus)
     EVT_KILL_FOCUS(SyntaxTextCtrl::OnKillFocus)
     EVT_SIZE(SyntaxTextCtrl::OnSize)
-    EVT_TIMER(CURSOR_TIMER_ID, SyntaxTextCtrl::OnCursorTimer)
+    EVT_SHOW(SyntaxTextCtrl::OnShow)
+    EVT_IDLE(SyntaxTextCtrl::OnIdle)
+    EVT_TIMER(COMPLETION_TIMER_ID, SyntaxTextCtrl::OnCompletionTimer)
+    EVT_TIMER(DRAG_TIMER_ID, SyntaxTextCtrl::OnDragTimer)
+    EVT_TIMER(PERF_LOG_TIMER_ID, SyntaxTextCtrl::OnPerfLogTimer)
 wxEND_EVENT_TABLE()
 
+void TextLayout::Build(const wxDC& dc, const wxString& text) {
+    m_advances.assign(1, 0);
+    m_cellWidth = 0;
+    m_advances.reserve(text.length() + 1);
+    
+    wxArrayInt widths;
+    if (!text.IsEmpty() && dc.GetPartialTextExtents(text, widths)) {
+        for (size_t i = 0; i < widths.size(); i++) {
+            m_advances.push_back(widths[i]);
+        }
+    }
+    
+    // Pad with the last known advance if the DC could not measure the text
+    m_advances.resize(text.length() + 1, m_advances.back());
+    m_valid = true;
+}
+
+void TextLayout::Build(wxDC& dc, const wxString& text, const std::vector<FontRun>& runs) {
+    m_advances.assign(1, 0);
+    m_cellWidth = 0;
+    m_advances.reserve(text.length() + 1);
+    
+    wxFont baseFont = dc.GetFont();
+    wxArrayInt widths;
+    
+    // Appends the advances up to caret position end, measuring the text in font
+    auto measure = [&](size_t end, const wxFont& font) {
+        size_t pos = m_advances.size() - 1;
+        if (end <= pos) return;
+        
+        int offset = m_advances.back();
+        dc.SetFont(font);
+        if (dc.GetPartialTextExtents(text.Mid(pos, end - pos), widths)) {
+            for (size_t i = 0; i < widths.size(); i++) {
+                m_advances.push_back(offset + widths[i]);
+            }
+        }
+        m_advances.resize(end + 1, m_advances.back());
+    };
+    
+    for (const auto& run : runs) {
+        measure(std::min(run.start, text.length()), baseFont);
+        measure(std::min(run.start + run.length, text.length()), *run.font);
+    }
+    measure(text.length(), baseFont);
+    
+    dc.SetFont(baseFont);
+    m_valid = true;
+}
+
+void TextLayout::Build(size_t length, double cellWidth) {
+    m_advances.assign(1, 0);
+    m_cellWidth = cellWidth;
+    m_length = length;
+    m_valid = true;
+}
+
+int TextLayout::GetX(size_t pos) const {
+    if (m_cellWidth > 0) {
+        return static_cast<int>(std::min(pos, m_length) * m_cellWidth + 0.5);
+    }
+    return m_advances[std::min(pos, m_advances.size() - 1)];
+}
+
+size_t TextLayout::GetPosFromX(int x) const {
+    if (x <= 0) return 0;
+    
+    if (m_cellWidth > 0) {
+        return std::min(static_cast<size_t>(x / m_cellWidth + 0.5), m_length);
+    }
+    
+    // First caret position to the right of x, then snap to whichever neighbour is closer
+    auto it = std::upper_bound(m_advances.begin(), m_advances.end(), x);
+    if (it == m_advances.end()) {
+        return m_advances.size() - 1;
+    }
+    
+    size_t pos = it - m_advances.begin();
+    if (*it - x > x - m_advances[pos - 1]) {
+        return pos - 1;
+    }
+    return pos;
+}
+
+CompletionListBox::CompletionListBox(wxWindow* parent)
+    : wxVListBox(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLB_SINGLE) {
+}
+
+void CompletionListBox::SetItems(std::vector<wxString> items) {
+    m_items.swap(items);
+    SetItemCount(m_items.size());
+    Refresh();
+}
+
+void CompletionListBox::OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const {
+    dc.SetFont(GetFont());
+    dc.SetTextForeground(IsSelected(n) ? wxSystemSettings::GetColour(wxSYS_COLOUR_HIGHLIGHTTEXT)
+                                       : GetForegroundColour());
+    dc.DrawText(m_items[n], rect.x + 2, rect.y + 2);
+}
+
+wxCoord CompletionListBox::OnMeasureItem(size_t WXUNUSED(n)) const {
+    return GetCharHeight() + 4;
+}
+
 CompletionPopup::CompletionPopup(wxWindow* parent, SyntaxTextCtrl* textCtrl)
     : wxPopupWindow(parent, wxBORDER_SIMPLE),
       m_textCtrl(textCtrl) {
-    m_listBox = new wxListBox(this, wxID_ANY, wxDefaultPosition, wxDefaultSize);
+    m_listBox = new CompletionListBox(this);
     
     wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
     sizer->Add(m_listBox, 1, wxEXPAND);
@@ -55,11 +286,8 @@ CompletionPopup::CompletionPopup(wxWindow* parent, SyntaxTextCtrl* textCtrl)
     m_listBox->Bind(wxEVT_LISTBOX_DCLICK, &CompletionPopup::OnListBoxDClick, this);
 }
 
-void CompletionPopup::SetCompletions(const std::vector<wxString>& completions) {
-    m_listBox->Clear();
-    for (const auto& comp : completions) {
-        m_listBox->Append(comp);
-    }
+void CompletionPopup::SetCompletions(std::vector<wxString> completions) {
+    m_listBox->SetItems(std::move(completions));
     if (m_listBox->GetCount() > 0) {
         m_listBox->SetSelection(0);
     }
@@ -69,7 +297,7 @@ void CompletionPopup::SetCompletions(const std::vector<wxString>& completions) {
 wxString CompletionPopup::GetSelectedCompletion() const {
     int sel = m_listBox->GetSelection();
     if (sel != wxNOT_FOUND) {
-        return m_listBox->GetString(sel);
+        return m_listBox->GetItem(sel);
     }
     return wxEmptyString;
 }
@@ -92,6 +320,25 @@ bool CompletionPopup::SelectPrevious() {
     return false;
 }
 
+bool CompletionPopup::SelectNextPage() {
+    int sel = m_listBox->GetSelection();
+    int last = (int)m_listBox->GetCount() - 1;
+    if (sel < last) {
+        m_listBox->SetSelection(wxMin(sel + COMPLETION_VISIBLE_ROWS, last));
+        return true;
+    }
+    return false;
+}
+
+bool CompletionPopup::SelectPreviousPage() {
+    int sel = m_listBox->GetSelection();
+    if (sel > 0) {
+        m_listBox->SetSelection(wxMax(sel - COMPLETION_VISIBLE_ROWS, 0));
+        return true;
+    }
+    return false;
+}
+
 void CompletionPopup::OnListBoxClick(wxCommandEvent& WXUNUSED(event)) {
 }
 
@@ -111,19 +358,21 @@ void CompletionPopup::UpdateSize() {
         return;
     }
     
+    int visibleItems = wxMin((int)m_listBox->GetCount(), COMPLETION_VISIBLE_ROWS);
+    
+    // Only the first page is measured; wider rows further down are clipped
     wxClientDC dc(m_listBox);
     dc.SetFont(m_listBox->GetFont());
     int maxWidth = 150;
     
-    for (unsigned int i = 0; i < m_listBox->GetCount(); i++) {
-        wxSize textSize = dc.GetTextExtent(m_listBox->GetString(i));
+    for (int i = 0; i < visibleItems; i++) {
+        wxSize textSize = dc.GetTextExtent(m_listBox->GetItem(i));
         maxWidth = wxMax(maxWidth, textSize.GetWidth() + 30);
     }
     
     maxWidth = wxMin(maxWidth, 400);
     
     int itemHeight = m_listBox->GetCharHeight() + 4;
-    int visibleItems = wxMin((int)m_listBox->GetCount(), 8);
     int height = itemHeight * visibleItems + 10;
     
     height = wxMax(height, 50);
@@ -139,16 +388,28 @@ SyntaxTextCtrl::SyntaxTextCtrl(wxWindow* parent, wxWindowID id,
                                const wxSize& size,
                                long WXUNUSED(style))
     : wxControl(parent, id, pos, size, wxBORDER_SUNKEN | wxWANTS_CHARS),
-      m_text(value),
-      m_cursorPos(0),
-      m_selectionStart(0),
-      m_selectionEnd(0),
+      m_model(value),
       m_completionPopup(nullptr),
       m_showingCompletions(false),
-      m_cursorTimer(nullptr),
+      m_completionTimer(nullptr),
+      m_completionDelay(DEFAULT_COMPLETION_DELAY),
+      m_completionGeneration(0),
       m_cursorVisible(true),
       m_scrollOffset(0),
-      m_dragging(false) {
+      m_renderedTiles(0),
+      m_lineCacheValid(false),
+      m_cachedSelectionStart(0),
+      m_cachedSelectionEnd(0),
+      m_cachedScrollOffset(0),
+      m_lineHeight(0),
+      m_singleCellText(-1),
+      m_dragging(false),
+      m_dragPending(false),
+      m_dragTimer(nullptr),
+      m_dirty(0),
+      m_highlightRevision(0),
+      m_perfEnabled(false),
+      m_perfLogTimer(nullptr) {
     
     SetBackgroundStyle(wxBG_STYLE_PAINT);
     
@@ -159,176 +420,507 @@ SyntaxTextCtrl::SyntaxTextCtrl(wxWindow* parent, wxWindowID id,
     m_cursorColor = *wxBLACK;
     m_leftMargin = 5;
     m_topMargin = 5;
+    ResetStyleFonts();
+    
+    m_model.SetDefaultColor(m_defaultTextColor);
+    m_model.SetChangeFunction([this](size_t pos, size_t removed, size_t inserted) {
+        MarkTextChanged(pos, removed, inserted);
+    });
     
-    m_cursorTimer = new wxTimer(this, CURSOR_TIMER_ID);
+    if (s_controlCount++ == 0) {
+        s_caretBlinker = new CaretBlinker();
+    }
+    m_completionTimer = new wxTimer(this, COMPLETION_TIMER_ID);
+    m_dragTimer = new wxTimer(this, DRAG_TIMER_ID);
     
     SetCursor(wxCursor(wxCURSOR_IBEAM));
     
-    UpdateControlHeight();
+    // Fonts and the line height are only measured once the control is laid out or
+    // painted, so filling a large form costs little for the controls never shown
 }
 
 SyntaxTextCtrl::~SyntaxTextCtrl() {
-    if (m_cursorTimer) {
-        m_cursorTimer->Stop();
-        delete m_cursorTimer;
+    // Joins the workers, so no further results are queued for this window
+    m_completionWorker.reset();
+    m_highlightWorker.reset();
+    m_completionTimer->Stop();
+    delete m_completionTimer;
+    s_caretBlinker->Detach(this);
+    if (--s_controlCount == 0) {
+        delete s_caretBlinker;
+        s_caretBlinker = nullptr;
     }
+    EndDrag();
+    delete m_dragTimer;
+    delete m_perfLogTimer;
     if (m_completionPopup) {
         m_completionPopup->Destroy();
     }
 }
 
 void SyntaxTextCtrl::SetValue(const wxString& value) {
-    SaveUndoState();
-    m_text = value;
-    m_cursorPos = value.length();
-    m_selectionStart = m_cursorPos;
-    m_selectionEnd = m_cursorPos;
+    m_model.SetValue(value);
     m_scrollOffset = 0;
-    EnsureCursorVisible();
-    Refresh();
+    MarkDirty(DIRTY_CARET);
+}
+
+void SyntaxTextCtrl::LoadValue(const wxString& value) {
+    m_model.LoadValue(value);
+    m_scrollOffset = 0;
+    MarkDirty(DIRTY_CARET);
+}
+
+void SyntaxTextCtrl::SetSyntaxGrammar(SyntaxGrammarPtr grammar) {
+    m_model.GetHighlighter().SetGrammar(grammar);
+    m_layout.Invalidate();
+    InvalidateLine();
+    MarkDirty(DIRTY_PAINT);
 }
 
 void SyntaxTextCtrl::AddSyntaxRule(const std::string& regexPattern, ColorFunc colorFunc) {
-    m_syntaxRules.emplace_back(regexPattern, colorFunc);
+    m_model.GetHighlighter().AddRule(regexPattern, colorFunc);
+    m_layout.Invalidate();
+    InvalidateLine();
+}
+
+void SyntaxTextCtrl::AddSyntaxRule(const std::string& regexPattern, StyleId style) {
+    m_model.GetHighlighter().AddRule(regexPattern, style);
+    m_layout.Invalidate();
+    InvalidateLine();
+}
+
+void SyntaxTextCtrl::AddSyntaxRule(const std::string& regexPattern, StyleFunc styleFunc) {
+    m_model.GetHighlighter().AddRule(regexPattern, styleFunc);
+    m_layout.Invalidate();
+    InvalidateLine();
+}
+
+void SyntaxTextCtrl::AddSyntaxRule(const std::string& regexPattern, const std::vector<GroupStyle>& groupStyles) {
+    m_model.GetHighlighter().AddRule(regexPattern, groupStyles);
+    m_layout.Invalidate();
+    InvalidateLine();
 }
 
 void SyntaxTextCtrl::ClearSyntaxRules() {
-    m_syntaxRules.clear();
+    m_model.GetHighlighter().ClearRules();
+    m_layout.Invalidate();
+    InvalidateLine();
+}
+
+StyleId SyntaxTextCtrl::AddSyntaxStyle(const TextStyle& style) {
+    return m_model.GetHighlighter().AddStyle(style);
+}
+
+void SyntaxTextCtrl::SetSyntaxStyle(StyleId id, const TextStyle& style) {
+    m_model.GetHighlighter().SetStyle(id, style);
+    m_layout.Invalidate();
+    InvalidateLine();
+    MarkDirty(DIRTY_PAINT);
+}
+
+void SyntaxTextCtrl::SetSyntaxEngine(SyntaxEngine engine) {
+    m_model.GetHighlighter().SetEngine(engine);
+    m_layout.Invalidate();
+    InvalidateLine();
+    MarkDirty(DIRTY_PAINT);
+}
+
+void SyntaxTextCtrl::SetBackgroundHighlighting(bool enable) {
+    if (enable == IsBackgroundHighlighting()) return;
+    
+    m_highlightGrammar.reset();
+    if (enable) {
+        m_highlightWorker.reset(new HighlightWorker([this](const HighlightResult& result) {
+            // Called on the worker thread; CallAfter hands the result to the UI thread
+            CallAfter(&SyntaxTextCtrl::OnHighlightReady, result);
+        }));
+        const SyntaxHighlighter& highlighter = m_model.GetHighlighter();
+        m_highlightWorker->SetMatchBudget(highlighter.GetMatchBudget(), highlighter.GetBudgetExceededFunction());
+    } else {
+        m_highlightWorker.reset();
+        m_model.SetExternalHighlighting(false);
+        m_layout.Invalidate();
+        InvalidateLine();
+    }
+    MarkDirty(DIRTY_PAINT);
+}
+
+void SyntaxTextCtrl::SetSyntaxMatchBudget(int milliseconds) {
+    SyntaxHighlighter& highlighter = m_model.GetHighlighter();
+    highlighter.SetMatchBudget(milliseconds);
+    if (m_highlightWorker) {
+        m_highlightWorker->SetMatchBudget(milliseconds, highlighter.GetBudgetExceededFunction());
+    }
+}
+
+void SyntaxTextCtrl::SetSyntaxBudgetExceededFunction(BudgetExceededFunc func) {
+    SyntaxHighlighter& highlighter = m_model.GetHighlighter();
+    highlighter.SetBudgetExceededFunction(func);
+    if (m_highlightWorker) {
+        m_highlightWorker->SetMatchBudget(highlighter.GetMatchBudget(), func);
+    }
+}
+
+void SyntaxTextCtrl::UpdateBackgroundHighlighting() {
+    if (!m_highlightWorker) return;
+    
+    // ColorFunc results become palette entries, which only this thread may add
+    SyntaxGrammarPtr grammar = m_model.GetHighlighter().GetGrammar();
+    bool background = grammar->IsCacheable();
+    if (background != m_model.IsExternalHighlighting()) {
+        m_model.SetExternalHighlighting(background);
+        m_layout.Invalidate();
+        InvalidateLine();
+    }
+    if (!background) return;
+    
+    if (grammar != m_highlightGrammar || m_model.GetRevision() != m_highlightRevision) {
+        m_highlightGrammar = grammar;
+        m_highlightRevision = m_model.GetRevision();
+        m_highlightWorker->Submit(grammar, m_model.GetValue(), m_highlightRevision);
+    }
 }
 
-void SyntaxTextCtrl::SetCompletionFunction(CompletionFunc func) {
+void SyntaxTextCtrl::OnHighlightReady(HighlightResult result) {
+    // Rules changed after the snapshot was submitted
+    if (!m_highlightWorker || result.grammar != m_highlightGrammar) return;
+    
+    m_model.SetHighlightResult(result.revision, result.tokens);
+    m_layout.Invalidate();
+    InvalidateLine();
+    MarkDirty(DIRTY_PAINT);
+}
+
+void SyntaxTextCtrl::SetCompletionFunction(CompletionFunc func, bool prefixFilterable) {
+    m_completionTimer->Stop();
+    m_completionWorker.reset();
     m_completionFunc = func;
+    m_completionCache.Clear();
+    m_completionCache.SetPrefixFilterable(prefixFilterable);
+}
+
+void SyntaxTextCtrl::SetAsyncCompletionFunction(AsyncCompletionFunc func, bool prefixFilterable) {
+    m_completionTimer->Stop();
+    m_completionWorker.reset();
+    m_completionFunc = nullptr;
+    m_completionCache.Clear();
+    m_completionCache.SetPrefixFilterable(prefixFilterable);
+    
+    if (func) {
+        m_completionWorker.reset(new CompletionWorker(func,
+            [this](unsigned long generation, const std::vector<wxString>& completions) {
+                // Called on the worker thread; CallAfter hands the result to the UI thread
+                CallAfter(&SyntaxTextCtrl::OnCompletionsReady, generation, completions);
+            }));
+    }
 }
 
 void SyntaxTextCtrl::SetTextFont(const wxFont& font) {
     m_font = font;
+    m_layout.Invalidate();
+    ResetStyleFonts();
     UpdateControlHeight();
-    EnsureCursorVisible();
-    Refresh();
+    MarkDirty(DIRTY_CARET);
 }
 
 void SyntaxTextCtrl::SetTextFont(int pointSize, wxFontFamily family,
                                   wxFontStyle style, wxFontWeight weight) {
     m_font = wxFont(pointSize, family, style, weight);
+    m_layout.Invalidate();
+    ResetStyleFonts();
     UpdateControlHeight();
-    EnsureCursorVisible();
-    Refresh();
+    MarkDirty(DIRTY_CARET);
 }
 
 void SyntaxTextCtrl::SetFontSize(int pointSize) {
     m_font.SetPointSize(pointSize);
+    m_layout.Invalidate();
+    ResetStyleFonts();
     UpdateControlHeight();
-    EnsureCursorVisible();
-    Refresh();
+    MarkDirty(DIRTY_CARET);
 }
 
 void SyntaxTextCtrl::SetFontFamily(wxFontFamily family) {
     m_font.SetFamily(family);
+    m_layout.Invalidate();
+    ResetStyleFonts();
     UpdateControlHeight();
-    EnsureCursorVisible();
-    Refresh();
+    MarkDirty(DIRTY_CARET);
 }
 
 void SyntaxTextCtrl::SetSelection(long from, long to) {
-    m_selectionStart = std::max(0L, std::min(from, (long)m_text.length()));
-    m_selectionEnd = std::max(0L, std::min(to, (long)m_text.length()));
-    m_cursorPos = m_selectionEnd;
-    Refresh();
+    m_model.SetSelection(std::max(0L, from), std::max(0L, to));
+    MarkDirty(DIRTY_PAINT);
 }
 
 void SyntaxTextCtrl::GetSelection(long* from, long* to) const {
-    if (from) *from = std::min(m_selectionStart, m_selectionEnd);
-    if (to) *to = std::max(m_selectionStart, m_selectionEnd);
+    if (from) *from = m_model.GetSelectionStart();
+    if (to) *to = m_model.GetSelectionEnd();
 }
 
 void SyntaxTextCtrl::Undo() {
-    if (!CanUndo()) return;
-    
-    m_redoStack.push_back({m_text, m_cursorPos});
-    if (m_redoStack.size() > MAX_UNDO_LEVELS) {
-        m_redoStack.pop_front();
-    }
-    
-    TextState state = m_undoStack.back();
-    m_undoStack.pop_back();
-    m_text = state.text;
-    m_cursorPos = state.cursorPos;
-    m_selectionStart = m_cursorPos;
-    m_selectionEnd = m_cursorPos;
+    if (!m_model.Undo()) return;
     
     HideCompletions();
-    Refresh();
+    MarkDirty(DIRTY_CARET);
 }
 
 void SyntaxTextCtrl::Redo() {
-    if (!CanRedo()) return;
+    if (!m_model.Redo()) return;
+    
+    HideCompletions();
+    MarkDirty(DIRTY_CARET);
+}
+
+void SyntaxTextCtrl::EnablePerfStats(bool enable, int logInterval) {
+    m_perfEnabled = enable;
+    m_model.GetHighlighter().SetPerfStats(enable ? &m_perfStats.highlight : nullptr);
     
-    m_undoStack.push_back({m_text, m_cursorPos});
-    if (m_undoStack.size() > MAX_UNDO_LEVELS) {
-        m_undoStack.pop_front();
+    if (enable && logInterval > 0) {
+        if (!m_perfLogTimer) {
+            m_perfLogTimer = new wxTimer(this, PERF_LOG_TIMER_ID);
+        }
+        m_perfLogTimer->Start(logInterval);
+    } else if (m_perfLogTimer) {
+        m_perfLogTimer->Stop();
     }
+}
+
+const SyntaxTextPerfStats& SyntaxTextCtrl::GetPerfStats() {
+    m_perfStats.undoMemory = m_model.GetUndoMemoryUsage();
+    return m_perfStats;
+}
+
+void SyntaxTextCtrl::ResetPerfStats() {
+    m_perfStats.paint.Reset();
+    m_perfStats.highlight.update.Reset();
+    m_perfStats.highlight.rules.clear();
+    m_perfStats.completion.Reset();
+    m_perfStats.popup.Reset();
+    m_perfStats.hitTest.Reset();
+}
+
+void SyntaxTextCtrl::OnPerfLogTimer(wxTimerEvent& WXUNUSED(event)) {
+    wxLogTrace("SyntaxTextCtrl", "%s", GetPerfStats().Format());
+}
+
+static wxString FormatHistogram(const wxString& name, const LatencyHistogram& histogram) {
+    return wxString::Format("%-12s %8lu calls  p50 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+                            name, (unsigned long)histogram.GetCount(), histogram.GetPercentile(0.5),
+                            histogram.GetPercentile(0.99), histogram.GetMax());
+}
+
+wxString SyntaxTextPerfStats::Format() const {
+    wxString text;
+    text += FormatHistogram("paint", paint);
+    text += FormatHistogram("highlight", highlight.update);
+    for (size_t i = 0; i < highlight.rules.size(); i++) {
+        text += FormatHistogram(wxString::Format("  rule %lu", (unsigned long)i), highlight.rules[i]);
+    }
+    text += FormatHistogram("completion", completion);
+    text += FormatHistogram("popup", popup);
+    text += FormatHistogram("hit test", hitTest);
+    text += wxString::Format("undo memory  %8lu bytes\n", (unsigned long)undoMemory);
+    return text;
+}
+
+void SyntaxTextCtrl::OnPaint(wxPaintEvent& WXUNUSED(event)) {
+    PerfTimer timer(GetPerfCounter(m_perfStats.paint));
+    wxPaintDC dc(this);
+    
+    // The paint may arrive before the idle tick, so the view must not lag behind. It is
+    // being repainted already, and updating completions may show the popup, which must
+    // not happen inside a paint handler; that waits until after the paint.
+    ResolveView();
+    if (m_dirty & DIRTY_COMPLETIONS) {
+        CallAfter(&SyntaxTextCtrl::ResolveDirty);
+    }
+    UpdateBackgroundHighlighting();
     
-    TextState state = m_redoStack.back();
-    m_redoStack.pop_back();
-    m_text = state.text;
-    m_cursorPos = state.cursorPos;
-    m_selectionStart = m_cursorPos;
-    m_selectionEnd = m_cursorPos;
+    // Showing a parent sends no show event to its children, but they get painted
+    s_caretBlinker->Resume(this);
     
-    HideCompletions();
-    Refresh();
+    wxSize clientSize = GetClientSize();
+    if (clientSize.GetWidth() <= 0 || clientSize.GetHeight() <= 0) return;
+    
+    if (!IsLineCacheValid(clientSize)) {
+        RenderLine(clientSize);
+    }
+    
+    // Copy back only the invalidated part, which for a caret blink is just the caret
+    wxRect update = GetUpdateClientRect();
+    wxMemoryDC lineDC(m_lineBitmap);
+    dc.Blit(update.x, update.y, update.width, update.height, &lineDC, update.x, update.y);
+    lineDC.SelectObject(wxNullBitmap);
+    
+    if (HasFocus() && !HasSelection() && m_cursorVisible) {
+        wxRect caret = GetCaretRect();
+        dc.SetClippingRegion(m_leftMargin, 0, clientSize.GetWidth() - m_leftMargin, clientSize.GetHeight());
+        dc.SetPen(wxPen(m_cursorColor, 2));
+        dc.DrawLine(caret.x + 1, caret.y, caret.x + 1, caret.y + caret.height);
+        dc.DestroyClippingRegion();
+    }
 }
 
-void SyntaxTextCtrl::OnPaint(wxPaintEvent& WXUNUSED(event)) {
-    wxAutoBufferedPaintDC dc(this);
+void SyntaxTextCtrl::RenderLine(const wxSize& size) {
+    if (!m_lineBitmap.IsOk() || m_lineBitmap.GetSize() != size) {
+        if (m_lineBitmap.IsOk() && m_lineBitmap.GetHeight() != size.GetHeight()) {
+            ReleaseTiles();
+        }
+        m_lineBitmap.Create(size);
+    }
     
+    wxMemoryDC dc(m_lineBitmap);
     dc.SetBackground(wxBrush(m_backgroundColor));
     dc.Clear();
     
-    dc.SetFont(m_font);
-    
-    int textY = m_topMargin;
-    wxSize clientSize = GetClientSize();
+    // The viewport is composed from the pre-rendered tiles, the selection from their
+    // selected variants, so scrolling and selecting never redraw glyphs
+    int viewportEnd = m_scrollOffset + size.GetWidth() - m_leftMargin;
+    BlitTiles(dc, m_scrollOffset, viewportEnd, false);
+    
+    size_t selStart = m_model.GetSelectionStart();
+    size_t selEnd = m_model.GetSelectionEnd();
+    if (selStart != selEnd) {
+        const TextLayout& layout = GetTextLayout();
+        BlitTiles(dc, std::max(layout.GetX(selStart), m_scrollOffset),
+                  std::min(layout.GetX(selEnd), viewportEnd), true);
+    }
     
-    dc.SetClippingRegion(m_leftMargin, 0, clientSize.GetWidth() - m_leftMargin, clientSize.GetHeight());
+    dc.SelectObject(wxNullBitmap);
     
-    std::vector<ColoredSegment> segments = GetColoredSegments();
+    m_lineCacheValid = true;
+    m_cachedSelectionStart = selStart;
+    m_cachedSelectionEnd = selEnd;
+    m_cachedScrollOffset = m_scrollOffset;
+}
+
+void SyntaxTextCtrl::BlitTiles(wxDC& dc, int from, int to, bool selected) {
+    int height = m_lineBitmap.GetHeight();
     
-    if (HasSelection()) {
-        size_t selStart = std::min(m_selectionStart, m_selectionEnd);
-        size_t selEnd = std::max(m_selectionStart, m_selectionEnd);
-        
-        wxString beforeSel = m_text.Mid(0, selStart);
-        wxString selected = m_text.Mid(selStart, selEnd - selStart);
+    while (from < to) {
+        size_t index = from / LINE_TILE_WIDTH;
+        int tileX = (int)index * LINE_TILE_WIDTH;
+        int end = std::min(to, tileX + LINE_TILE_WIDTH);
         
-        wxSize beforeSize = dc.GetTextExtent(beforeSel);
-        wxSize selSize = dc.GetTextExtent(selected);
+        wxMemoryDC tileDC(GetTile(index, selected));
+        dc.Blit(m_leftMargin + from - m_scrollOffset, 0, end - from, height, &tileDC, from - tileX, 0);
+        tileDC.SelectObject(wxNullBitmap);
         
-        dc.SetBrush(wxBrush(m_selectionColor));
-        dc.SetPen(*wxTRANSPARENT_PEN);
-        dc.DrawRectangle(m_leftMargin + beforeSize.GetWidth() - m_scrollOffset, textY,
-                        selSize.GetWidth(), dc.GetCharHeight());
+        from = end;
+    }
+}
+
+wxBitmap& SyntaxTextCtrl::GetTile(size_t index, bool selected) {
+    if (index >= m_tiles.size()) {
+        m_tiles.resize(index + 1);
     }
     
-    int currentX = m_leftMargin - m_scrollOffset;
+    wxBitmap& tile = selected ? m_tiles[index].selected : m_tiles[index].normal;
+    if (tile.IsOk()) {
+        return tile;
+    }
     
-    for (const auto& seg : segments) {
-        wxString segText = m_text.Mid(seg.start, seg.length);
-        dc.SetTextForeground(seg.color);
-        dc.DrawText(segText, currentX, textY);
-        currentX += dc.GetTextExtent(segText).GetWidth();
+    // Keep memory bounded on very long lines by dropping tiles away from the viewport
+    if (m_renderedTiles >= MAX_LINE_TILES) {
+        size_t first = m_scrollOffset / LINE_TILE_WIDTH;
+        size_t last = (m_scrollOffset + GetClientSize().GetWidth()) / LINE_TILE_WIDTH;
+        for (size_t i = 0; i < m_tiles.size(); i++) {
+            if (i + 1 < first || i > last + 1) {
+                m_renderedTiles -= m_tiles[i].normal.IsOk() + m_tiles[i].selected.IsOk();
+                m_tiles[i] = LineTile();
+            }
+        }
     }
     
-    if (HasFocus() && !HasSelection() && m_cursorVisible) {
-        wxString beforeCursor = m_text.Mid(0, m_cursorPos);
-        wxSize beforeSize = dc.GetTextExtent(beforeCursor);
+    RenderTile(tile, index, selected);
+    m_renderedTiles++;
+    return tile;
+}
+
+void SyntaxTextCtrl::RenderTile(wxBitmap& tile, size_t index, bool selected) {
+    tile.Create(LINE_TILE_WIDTH, m_lineBitmap.GetHeight());
+    
+    wxMemoryDC dc(tile);
+    dc.SetBackground(wxBrush(m_backgroundColor));
+    dc.Clear();
+    dc.SetFont(m_font);
+    dc.SetPen(*wxTRANSPARENT_PEN);
+    
+    int textY = m_topMargin;
+    int tileX = (int)index * LINE_TILE_WIDTH;
+    
+    const std::vector<StyledSegment>& segments = m_model.GetStyledSegments();
+    const TextLayout& layout = GetTextLayout();
+    
+    // Only characters overlapping the tile are drawn, placed from the cached advances.
+    // Characters straddling the edge are drawn by both neighbours, so tiles join seamlessly.
+    size_t firstVisible = layout.GetPosFromX(tileX);
+    if (firstVisible > 0 && layout.GetX(firstVisible) > tileX) {
+        firstVisible--;
+    }
+    size_t lastVisible = layout.GetPosFromX(tileX + LINE_TILE_WIDTH);
+    if (lastVisible < m_model.GetLength() && layout.GetX(lastVisible) < tileX + LINE_TILE_WIDTH) {
+        lastVisible++;
+    }
+    
+    auto firstSeg = std::upper_bound(segments.begin(), segments.end(), firstVisible,
+        [](size_t pos, const StyledSegment& segment) { return pos < segment.start + segment.length; });
+    
+    if (selected) {
+        dc.SetBrush(wxBrush(m_selectionColor));
+        dc.DrawRectangle(0, textY, LINE_TILE_WIDTH, GetLineHeight());
+    } else {
+        for (auto seg = firstSeg; seg != segments.end() && seg->start < lastVisible; ++seg) {
+            const TextStyle& style = m_model.GetStyle(seg->style);
+            if (style.background.IsOk()) {
+                int startX = layout.GetX(seg->start);
+                dc.SetBrush(wxBrush(style.background));
+                dc.DrawRectangle(startX - tileX, textY,
+                                 layout.GetX(seg->start + seg->length) - startX, GetLineHeight());
+            }
+        }
+    }
+    
+    // Runs are merged by style, so the font and color only change at real style boundaries
+    const wxFont* currentFont = &m_font;
+    for (auto seg = firstSeg; seg != segments.end() && seg->start < lastVisible; ++seg) {
+        const TextStyle& style = m_model.GetStyle(seg->style);
+        const wxFont* font = &GetStyleFont(style);
+        if (font != currentFont) {
+            dc.SetFont(*font);
+            currentFont = font;
+        }
         
-        dc.SetPen(wxPen(m_cursorColor, 2));
-        int cursorX = m_leftMargin + beforeSize.GetWidth() - m_scrollOffset;
-        dc.DrawLine(cursorX, textY, cursorX, textY + dc.GetCharHeight());
+        size_t start = std::max<size_t>(seg->start, firstVisible);
+        size_t end = std::min<size_t>(seg->start + seg->length, lastVisible);
+        dc.SetTextForeground(style.foreground);
+        dc.DrawText(m_model.GetRange(start, end - start), layout.GetX(start) - tileX, textY);
     }
     
-    dc.DestroyClippingRegion();
+    dc.SelectObject(wxNullBitmap);
+}
+
+void SyntaxTextCtrl::InvalidateLine() {
+    m_lineCacheValid = false;
+    ReleaseTiles();
+}
+
+void SyntaxTextCtrl::ReleaseTiles() {
+    m_tiles.clear();
+    m_renderedTiles = 0;
+}
+
+bool SyntaxTextCtrl::IsLineCacheValid(const wxSize& size) const {
+    return m_lineCacheValid && m_lineBitmap.IsOk() && m_lineBitmap.GetSize() == size &&
+           m_cachedSelectionStart == m_model.GetSelectionStart() &&
+           m_cachedSelectionEnd == m_model.GetSelectionEnd() &&
+           m_cachedScrollOffset == m_scrollOffset;
+}
+
+wxRect SyntaxTextCtrl::GetCaretRect() {
+    int cursorX = m_leftMargin + GetTextLayout().GetX(m_model.GetCursorPos()) - m_scrollOffset;
+    return wxRect(cursorX - 1, m_topMargin, 3, GetLineHeight());
 }
 
 void SyntaxTextCtrl::OnChar(wxKeyEvent& event) {
@@ -354,13 +946,8 @@ void SyntaxTextCtrl::OnChar(wxKeyEvent& event) {
     }
 
     if (unicodeKey >= WXK_SPACE) {
-        SaveUndoState();
-        DeleteSelection();
-        wxString ch(unicodeKey);
-        InsertText(ch);
-        UpdateCompletions();
-        m_cursorVisible = true;
-        m_cursorTimer->Start(500);
+        m_model.WriteText(wxString(unicodeKey), UndoJournal::EDIT_TYPING);
+        MarkDirty(DIRTY_CARET | DIRTY_COMPLETIONS);
     } else {
         event.Skip();
     }
@@ -389,6 +976,16 @@ void SyntaxTextCtrl::OnKeyDown(wxKeyEvent& event) {
         return;
     }
     
+    if (m_showingCompletions && m_completionPopup && keyCode == WXK_PAGEUP) {
+        m_completionPopup->SelectPreviousPage();
+        return;
+    }
+    
+    if (m_showingCompletions && m_completionPopup && keyCode == WXK_PAGEDOWN) {
+        m_completionPopup->SelectNextPage();
+        return;
+    }
+    
     if (keyCode == WXK_RETURN || keyCode == WXK_NUMPAD_ENTER) {
         if (m_showingCompletions && m_completionPopup) {
             AcceptCompletion();
@@ -428,57 +1025,20 @@ void SyntaxTextCtrl::OnKeyDown(wxKeyEvent& event) {
         return;
     }
     
-    if (keyCode == WXK_BACK) {
-        if (HasSelection()) {
-            SaveUndoState();
-            DeleteSelection();
-            UpdateCompletions();
-        } else if (m_cursorPos > 0) {
-            SaveUndoState();
-            DeleteChar(false);
-            UpdateCompletions();
+    if (keyCode == WXK_BACK || keyCode == WXK_DELETE) {
+        bool forward = keyCode == WXK_DELETE;
+        if (ctrlDown ? m_model.DeleteWord(forward) : m_model.Delete(forward)) {
+            MarkDirty(DIRTY_CARET | DIRTY_COMPLETIONS);
         }
         return;
     }
     
-    if (keyCode == WXK_DELETE) {
-        if (HasSelection()) {
-            SaveUndoState();
-            DeleteSelection();
-            UpdateCompletions();
-        } else if (m_cursorPos < m_text.length()) {
-            SaveUndoState();
-            DeleteChar(true);
-            UpdateCompletions();
-        }
-        return;
-    }
-    
-    if (keyCode == WXK_LEFT) {
+    if (keyCode == WXK_LEFT || keyCode == WXK_RIGHT) {
         if (ctrlDown) {
-            while (m_cursorPos > 0 && m_text[m_cursorPos - 1] == ' ') {
-                MoveCursor(-1, shiftDown);
-            }
-            while (m_cursorPos > 0 && m_text[m_cursorPos - 1] != ' ') {
-                MoveCursor(-1, shiftDown);
-            }
+            m_model.MoveCursorByWord(keyCode == WXK_RIGHT, shiftDown);
+            CursorMoved();
         } else {
-            MoveCursor(-1, shiftDown);
-        }
-        HideCompletions();
-        return;
-    }
-    
-    if (keyCode == WXK_RIGHT) {
-        if (ctrlDown) {
-            while (m_cursorPos < m_text.length() && m_text[m_cursorPos] != ' ') {
-                MoveCursor(1, shiftDown);
-            }
-            while (m_cursorPos < m_text.length() && m_text[m_cursorPos] == ' ') {
-                MoveCursor(1, shiftDown);
-            }
-        } else {
-            MoveCursor(1, shiftDown);
+            MoveCursor(keyCode == WXK_RIGHT ? 1 : -1, shiftDown);
         }
         HideCompletions();
         return;
@@ -491,7 +1051,7 @@ void SyntaxTextCtrl::OnKeyDown(wxKeyEvent& event) {
     }
     
     if (keyCode == WXK_END) {
-        SetCursorPos(m_text.length(), shiftDown);
+        SetCursorPos(m_model.GetLength(), shiftDown);
         HideCompletions();
         return;
     }
@@ -502,180 +1062,202 @@ void SyntaxTextCtrl::OnKeyDown(wxKeyEvent& event) {
 void SyntaxTextCtrl::OnMouseDown(wxMouseEvent& event) {
     SetFocus();
     
-    size_t pos = GetCursorPosFromPoint(event.GetPosition());
-    m_cursorPos = pos;
-    m_selectionStart = pos;
-    m_selectionEnd = pos;
-    m_dragging = true;
+    m_model.SetCursorPos(GetCursorPosFromPoint(event.GetPosition()), false);
+    if (!m_dragging) {
+        m_dragging = true;
+        CaptureMouse();
+    }
     
     HideCompletions();
-    Refresh();
+    MarkDirty(DIRTY_PAINT);
 }
 
 void SyntaxTextCtrl::OnMouseMove(wxMouseEvent& event) {
-    if (m_dragging && event.LeftIsDown()) {
-        size_t pos = GetCursorPosFromPoint(event.GetPosition());
-        m_cursorPos = pos;
-        m_selectionEnd = pos;
-        Refresh();
+    if (!m_dragging || !event.LeftIsDown()) return;
+    
+    // Only the latest position matters, it is hit-tested on the next frame
+    m_dragPoint = event.GetPosition();
+    m_dragPending = true;
+    if (!m_dragTimer->IsRunning()) {
+        m_dragTimer->Start(DRAG_FRAME_INTERVAL);
     }
 }
 
-void SyntaxTextCtrl::OnMouseUp(wxMouseEvent& WXUNUSED(event)) {
+void SyntaxTextCtrl::OnMouseUp(wxMouseEvent& event) {
+    if (!m_dragging) return;
+    
+    m_dragPoint = event.GetPosition();
+    m_dragPending = true;
+    UpdateDrag();
+    EndDrag();
+}
+
+void SyntaxTextCtrl::OnMouseCaptureLost(wxMouseCaptureLostEvent& WXUNUSED(event)) {
+    // The capture is already gone, so only the drag state is reset
     m_dragging = false;
+    m_dragPending = false;
+    m_dragTimer->Stop();
+}
+
+void SyntaxTextCtrl::OnDragTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (!UpdateDrag()) {
+        m_dragTimer->Stop();
+    }
+}
+
+bool SyntaxTextCtrl::UpdateDrag() {
+    int oldScrollOffset = m_scrollOffset;
+    size_t oldCursorPos = m_model.GetCursorPos();
+    size_t oldSelectionStart = m_model.GetSelectionStart();
+    size_t oldSelectionEnd = m_model.GetSelectionEnd();
+    
+    int visibleStart = m_leftMargin;
+    int visibleEnd = GetClientSize().GetWidth();
+    
+    // Past an edge the line scrolls each frame, faster the further out the pointer is
+    int distance = 0;
+    if (m_dragPoint.x < visibleStart) {
+        distance = m_dragPoint.x - visibleStart;
+    }
+    else if (m_dragPoint.x >= visibleEnd) {
+        distance = m_dragPoint.x - visibleEnd + 1;
+    }
+    
+    if (distance != 0) {
+        int step = std::min(std::abs(distance) / 2 + 1, MAX_AUTOSCROLL_STEP);
+        int maxOffset = std::max(0, GetTextLayout().GetWidth() - (visibleEnd - m_leftMargin - 10));
+        int offset = std::max(0, std::min(m_scrollOffset + (distance < 0 ? -step : step), maxOffset));
+        if (offset != m_scrollOffset) {
+            m_scrollOffset = offset;
+            m_dragPending = true;
+        }
+    }
+    
+    if (m_dragPending) {
+        wxPoint point(std::max(visibleStart, std::min(m_dragPoint.x, visibleEnd - 1)), m_dragPoint.y);
+        m_model.SetCursorPos(GetCursorPosFromPoint(point), true);
+        m_dragPending = false;
+    }
+    
+    // Moving within a character changes nothing on screen
+    if (m_scrollOffset != oldScrollOffset || m_model.GetCursorPos() != oldCursorPos ||
+        m_model.GetSelectionStart() != oldSelectionStart || m_model.GetSelectionEnd() != oldSelectionEnd) {
+        MarkDirty(DIRTY_PAINT);
+    }
+    
+    return distance != 0;
+}
+
+void SyntaxTextCtrl::EndDrag() {
+    m_dragging = false;
+    m_dragTimer->Stop();
+    if (HasCapture()) {
+        ReleaseMouse();
+    }
 }
 
 void SyntaxTextCtrl::OnSetFocus(wxFocusEvent& WXUNUSED(event)) {
-    m_cursorVisible = true;
-    m_cursorTimer->Start(500);
-    Refresh();
+    s_caretBlinker->Attach(this);
+    MarkDirty(DIRTY_PAINT);
 }
 
 void SyntaxTextCtrl::OnKillFocus(wxFocusEvent& WXUNUSED(event)) {
-    m_cursorTimer->Stop();
+    s_caretBlinker->Detach(this);
     HideCompletions();
-    Refresh();
+    MarkDirty(DIRTY_PAINT);
 }
 
 void SyntaxTextCtrl::OnSize(wxSizeEvent& event) {
-    Refresh();
+    MarkDirty(DIRTY_PAINT);
     event.Skip();
 }
 
-void SyntaxTextCtrl::OnCursorTimer(wxTimerEvent& WXUNUSED(event)) {
-    m_cursorVisible = !m_cursorVisible;
-    Refresh();
+void SyntaxTextCtrl::OnShow(wxShowEvent& event) {
+    if (event.IsShown()) {
+        s_caretBlinker->Resume(this);
+    }
+    event.Skip();
 }
 
-void SyntaxTextCtrl::InsertText(const wxString& text) {
-    m_text.insert(m_cursorPos, text);
-    m_cursorPos += text.length();
-    m_selectionStart = m_cursorPos;
-    m_selectionEnd = m_cursorPos;
-    m_redoStack.clear();
-    EnsureCursorVisible();
-    Refresh();
+void SyntaxTextCtrl::OnIdle(wxIdleEvent& event) {
+    // Controls that are not on screen stay dirty until their first paint, so a form
+    // full of hidden pages does no scrolling or highlighting work up front
+    if (IsShownOnScreen()) {
+        ResolveDirty();
+    }
+    event.Skip();
 }
 
-void SyntaxTextCtrl::DeleteSelection() {
-    if (!HasSelection()) return;
-    
-    size_t start = std::min(m_selectionStart, m_selectionEnd);
-    size_t end = std::max(m_selectionStart, m_selectionEnd);
-    
-    m_text.erase(start, end - start);
-    m_cursorPos = start;
-    m_selectionStart = start;
-    m_selectionEnd = start;
-    m_redoStack.clear();
-    Refresh();
+void SyntaxTextCtrl::MoveCursor(int delta, bool select) {
+    m_model.MoveCursor(delta, select);
+    CursorMoved();
 }
 
-void SyntaxTextCtrl::DeleteChar(bool forward) {
-    if (forward && m_cursorPos < m_text.length()) {
-        m_text.erase(m_cursorPos, 1);
-    } else if (!forward && m_cursorPos > 0) {
-        m_text.erase(m_cursorPos - 1, 1);
-        m_cursorPos--;
-    }
-    
-    m_selectionStart = m_cursorPos;
-    m_selectionEnd = m_cursorPos;
-    m_redoStack.clear();
-    EnsureCursorVisible();
-    Refresh();
+void SyntaxTextCtrl::SetCursorPos(size_t pos, bool select) {
+    m_model.SetCursorPos(pos, select);
+    CursorMoved();
 }
 
-void SyntaxTextCtrl::MoveCursor(int delta, bool select) {
-    if (!select && HasSelection() && delta != 0) {
-        if (delta < 0) {
-            m_cursorPos = std::min(m_selectionStart, m_selectionEnd);
-        } else {
-            m_cursorPos = std::max(m_selectionStart, m_selectionEnd);
-        }
-        m_selectionStart = m_cursorPos;
-        m_selectionEnd = m_cursorPos;
-    } else {
-        int newPos = (int)m_cursorPos + delta;
-        newPos = std::max(0, std::min(newPos, (int)m_text.length()));
-        m_cursorPos = newPos;
-        
-        if (!select) {
-            m_selectionStart = m_cursorPos;
-            m_selectionEnd = m_cursorPos;
-        } else {
-            m_selectionEnd = m_cursorPos;
-        }
-    }
-    
-    m_cursorVisible = true;
-    if (m_cursorTimer->IsRunning()) {
-        m_cursorTimer->Start(500);
+void SyntaxTextCtrl::CursorMoved() {
+    MarkDirty(DIRTY_CARET);
+}
+
+void SyntaxTextCtrl::MarkDirty(int flags) {
+    if (m_dirty == 0) {
+        wxWakeUpIdle();
     }
-    
-    EnsureCursorVisible();
-    Refresh();
+    m_dirty |= flags;
 }
 
-void SyntaxTextCtrl::SetCursorPos(size_t pos, bool select) {
-    m_cursorPos = std::min(pos, m_text.length());
+void SyntaxTextCtrl::ResolveDirty() {
+    if (m_dirty == 0) return;
     
-    if (!select) {
-        m_selectionStart = m_cursorPos;
-        m_selectionEnd = m_cursorPos;
-    } else {
-        m_selectionEnd = m_cursorPos;
-    }
+    bool changed = ResolveView();
     
-    m_cursorVisible = true;
-    if (m_cursorTimer->IsRunning()) {
-        m_cursorTimer->Start(500);
+    // After scrolling, so the popup is placed at the caret's final position
+    if (m_dirty & DIRTY_COMPLETIONS) {
+        m_dirty &= ~DIRTY_COMPLETIONS;
+        UpdateCompletions();
     }
     
-    EnsureCursorVisible();
-    Refresh();
+    if (changed) {
+        Refresh();
+    }
 }
 
-size_t SyntaxTextCtrl::GetCursorPosFromPoint(const wxPoint& point) {
-    wxClientDC dc(this);
-    dc.SetFont(m_font);
+bool SyntaxTextCtrl::ResolveView() {
+    // Take the flags first, resolving them may mark the control dirty again
+    int dirty = m_dirty & (DIRTY_PAINT | DIRTY_CARET);
+    m_dirty &= ~dirty;
     
-    int targetX = point.x - m_leftMargin + m_scrollOffset;
-    if (targetX <= 0) return 0;
-    
-    int currentX = 0;
-    for (size_t i = 0; i <= m_text.length(); i++) {
-        wxString substr = m_text.Mid(0, i);
-        int width = dc.GetTextExtent(substr).GetWidth();
-        
-        if (i == m_text.length() || width > targetX) {
-            if (i > 0 && width - targetX > targetX - currentX) {
-                return i - 1;
-            }
-            return i;
+    if (dirty & DIRTY_CARET) {
+        EnsureCursorVisible();
+        m_cursorVisible = true;
+        if (HasFocus()) {
+            s_caretBlinker->Attach(this);
         }
-        currentX = width;
     }
     
-    return m_text.length();
+    if (dirty == 0) return false;
+    UpdateBackgroundHighlighting();
+    return true;
+}
+
+size_t SyntaxTextCtrl::GetCursorPosFromPoint(const wxPoint& point) {
+    PerfTimer timer(GetPerfCounter(m_perfStats.hitTest));
+    int targetX = point.x - m_leftMargin + m_scrollOffset;
+    return GetTextLayout().GetPosFromX(targetX);
 }
 
 wxPoint SyntaxTextCtrl::GetPointFromCursorPos(size_t pos) {
-    wxClientDC dc(this);
-    dc.SetFont(m_font);
-    
-    wxString beforeCursor = m_text.Mid(0, pos);
-    int width = dc.GetTextExtent(beforeCursor).GetWidth();
-    
+    int width = GetTextLayout().GetX(pos);
     return wxPoint(m_leftMargin + width - m_scrollOffset, m_topMargin);
 }
 
 void SyntaxTextCtrl::CopyToClipboard() {
     if (!HasSelection()) return;
     
-    size_t start = std::min(m_selectionStart, m_selectionEnd);
-    size_t end = std::max(m_selectionStart, m_selectionEnd);
-    wxString selected = m_text.Mid(start, end - start);
+    wxString selected = m_model.GetSelectedText();
     
     if (wxTheClipboard->Open()) {
         wxTheClipboard->SetData(new wxTextDataObject(selected));
@@ -689,59 +1271,97 @@ void SyntaxTextCtrl::PasteFromClipboard() {
             wxTextDataObject data;
             wxTheClipboard->GetData(data);
             
-            SaveUndoState();
-            DeleteSelection();
-            InsertText(data.GetText());
-            UpdateCompletions();
+            m_model.WriteText(data.GetText());
+            MarkDirty(DIRTY_CARET | DIRTY_COMPLETIONS);
         }
         wxTheClipboard->Close();
     }
 }
 
 void SyntaxTextCtrl::SelectAll() {
-    m_selectionStart = 0;
-    m_selectionEnd = m_text.length();
-    m_cursorPos = m_text.length();
-    Refresh();
+    m_model.SelectAll();
+    MarkDirty(DIRTY_PAINT);
 }
 
-void SyntaxTextCtrl::SaveUndoState() {
-    m_undoStack.push_back({m_text, m_cursorPos});
-    if (m_undoStack.size() > MAX_UNDO_LEVELS) {
-        m_undoStack.pop_front();
+void SyntaxTextCtrl::UpdateCompletions() {
+    if (!m_completionWorker && !m_completionFunc) return;
+    
+    wxString textToCursor = m_model.GetTextBeforeCursor();
+    std::vector<wxString> completions;
+    bool cached = m_completionCache.Find(textToCursor, completions);
+    
+    if (m_completionWorker) {
+        // Supersede whatever is pending or running, then wait for typing to pause
+        m_completionGeneration = m_completionWorker->Cancel();
+        if (cached) {
+            m_completionTimer->Stop();
+            ShowCompletions(std::move(completions));
+        } else if (m_completionDelay > 0) {
+            m_completionTimer->StartOnce(m_completionDelay);
+        } else {
+            RequestCompletions();
+        }
+        return;
+    }
+    
+    if (!cached) {
+        PerfTimer timer(GetPerfCounter(m_perfStats.completion));
+        completions = m_completionFunc(textToCursor);
+        m_completionCache.Store(textToCursor, completions);
+    }
+    
+    if (!completions.empty()) {
+        ShowCompletions(std::move(completions));
+    } else {
+        HideCompletions();
     }
-    m_redoStack.clear();
 }
 
-void SyntaxTextCtrl::UpdateCompletions() {
-    if (!m_completionFunc) return;
+void SyntaxTextCtrl::RequestCompletions() {
+    if (!m_completionWorker) return;
     
-    wxString textToCursor = m_text.Mid(0, m_cursorPos);
+    m_completionRequested = std::chrono::steady_clock::now();
+    m_completionRequestText = m_model.GetTextBeforeCursor();
+    m_completionWorker->Submit(m_completionRequestText, m_completionGeneration);
+}
+
+void SyntaxTextCtrl::OnCompletionTimer(wxTimerEvent& WXUNUSED(event)) {
+    RequestCompletions();
+}
+
+void SyntaxTextCtrl::OnCompletionsReady(unsigned long generation, std::vector<wxString> completions) {
+    // Text or focus changed after the request was made
+    if (!m_completionWorker || generation != m_completionGeneration) return;
     
-    std::vector<wxString> completions = m_completionFunc(textToCursor);
+    if (m_perfEnabled) {
+        m_perfStats.completion.Record(std::chrono::steady_clock::now() - m_completionRequested);
+    }
+    m_completionCache.Store(m_completionRequestText, completions);
     
-    if (!completions.empty()) {
-        ShowCompletions(completions);
+    if (!completions.empty() && HasFocus()) {
+        ShowCompletions(std::move(completions));
     } else {
         HideCompletions();
     }
 }
 
-void SyntaxTextCtrl::ShowCompletions(const std::vector<wxString>& completions) {
+void SyntaxTextCtrl::ShowCompletions(std::vector<wxString> completions) {
     if (completions.empty()) {
         HideCompletions();
         return;
     }
     
+    PerfTimer timer(GetPerfCounter(m_perfStats.popup));
+    
     if (!m_completionPopup) {
         m_completionPopup = new CompletionPopup(this, this);
     }
     
-    m_completionPopup->SetCompletions(completions);
+    m_completionPopup->SetCompletions(std::move(completions));
     
-    wxPoint cursorPoint = GetPointFromCursorPos(m_cursorPos);
+    wxPoint cursorPoint = GetPointFromCursorPos(m_model.GetCursorPos());
     wxPoint screenPos = ClientToScreen(cursorPoint);
-    screenPos.y += GetCharHeight() + 2;
+    screenPos.y += GetLineHeight() + 2;
     
     m_completionPopup->Position(screenPos, wxSize(0, 0));
     
@@ -752,6 +1372,13 @@ void SyntaxTextCtrl::ShowCompletions(const std::vector<wxString>& completions) {
 }
 
 void SyntaxTextCtrl::HideCompletions() {
+    m_dirty &= ~DIRTY_COMPLETIONS;
+    
+    if (m_completionWorker) {
+        m_completionTimer->Stop();
+        m_completionGeneration = m_completionWorker->Cancel();
+    }
+    
     if (m_completionPopup && m_showingCompletions) {
         m_completionPopup->Hide();
         m_showingCompletions = false;
@@ -763,30 +1390,17 @@ void SyntaxTextCtrl::AcceptCompletion() {
     
     wxString completion = m_completionPopup->GetSelectedCompletion();
     if (!completion.IsEmpty()) {
-        SaveUndoState();
-        
-        size_t wordStart = m_cursorPos;
-        while (wordStart > 0 && m_text[wordStart - 1] != ' ') {
-            wordStart--;
-        }
-        
-        m_text.erase(wordStart, m_cursorPos - wordStart);
-        m_cursorPos = wordStart;
-        
-        InsertText(completion);
+        m_model.ReplaceWordBeforeCursor(completion);
+        MarkDirty(DIRTY_CARET);
     }
     
     HideCompletions();
     SetFocus();
-    Refresh();
+    MarkDirty(DIRTY_PAINT);
 }
 
 void SyntaxTextCtrl::EnsureCursorVisible() {
-    wxClientDC dc(this);
-    dc.SetFont(m_font);
-    
-    wxString beforeCursor = m_text.Mid(0, m_cursorPos);
-    int cursorPixelPos = dc.GetTextExtent(beforeCursor).GetWidth();
+    int cursorPixelPos = GetTextLayout().GetX(m_model.GetCursorPos());
     
     wxSize clientSize = GetClientSize();
     int visibleWidth = clientSize.GetWidth() - m_leftMargin - 10;
@@ -806,81 +1420,150 @@ void SyntaxTextCtrl::EnsureCursorVisible() {
 }
 
 void SyntaxTextCtrl::UpdateControlHeight() {
-    wxClientDC dc(this);
-    dc.SetFont(m_font);
-    
-    int charHeight = dc.GetCharHeight();
-    
-    int desiredHeight = m_topMargin * 2 + charHeight + 4;
-    
-    SetMinSize(wxSize(100, desiredHeight));
+    m_lineHeight = 0;
+    InvalidateLine();
+    InvalidateBestSize();
     
     wxWindow* parent = GetParent();
-    if (parent) {
-        wxSizer* sizer = parent->GetSizer();
-        if (sizer) {
-            sizer->Layout();
-        }
+    if (parent && parent->GetSizer()) {
+        ScheduleParentLayout(parent);
     }
 }
 
-std::vector<SyntaxTextCtrl::ColoredSegment> SyntaxTextCtrl::GetColoredSegments() const {
-    std::vector<ColoredSegment> segments;
-    
-    if (m_text.IsEmpty()) {
-        return segments;
+// Whether a fixed-pitch font draws the character in exactly one cell. Only printable
+// Latin (Basic Latin, Latin-1 and Latin Extended-A/B, IPA and spacing modifiers) is
+// recognised, which monospace fonts cover themselves. Any other character, e.g. Greek,
+// Cyrillic or CJK, makes the whole text measured instead: it may be drawn by a fallback
+// font, and wide or combining characters take two cells or none.
+static bool IsSingleCell(wchar_t c) {
+    return (c >= 0x20 && c < 0x7F) || (c >= 0xA0 && c < 0x300 && c != 0xAD);
+}
+
+void SyntaxTextCtrl::MarkTextChanged(size_t pos, size_t removed, size_t inserted) {
+    // Only inserting can add a character that does not fit a cell, and only removing
+    // can take the last one away, so typing Latin text checks just what was typed
+    if (m_singleCellText > 0) {
+        const wchar_t* chars = m_model.GetView(pos, pos + inserted);
+        if (!std::all_of(chars, chars + inserted, IsSingleCell)) {
+            m_singleCellText = 0;
+        }
+    } else if (m_singleCellText == 0 && removed > 0) {
+        m_singleCellText = -1;
     }
     
-    std::wstring text = m_text.ToStdWstring();
-    std::vector<bool> matched(text.length(), false);
-    
-    for (const auto& rule : m_syntaxRules) {
-        std::wsregex_iterator it(text.begin(), text.end(), rule.pattern);
-        std::wsregex_iterator end;
+    m_layout.Invalidate();
+    InvalidateLine();
+    MarkDirty(DIRTY_PAINT);
+}
+
+const TextLayout& SyntaxTextCtrl::GetTextLayout() {
+    if (!m_layout.IsValid()) {
+        size_t length = m_model.GetLength();
         
-        for (; it != end; ++it) {
-            size_t start = it->position();
-            size_t length = it->length();
-            
-            bool alreadyMatched = false;
-            for (size_t i = start; i < start + length; i++) {
-                if (matched[i]) {
-                    alreadyMatched = true;
+        // In a fixed-pitch font every position is a multiple of the character width
+        double cellWidth = GetCellWidth(TextStyle());
+        if (cellWidth > 0 && m_singleCellText < 0) {
+            const wchar_t* chars = m_model.GetView(0, length);
+            m_singleCellText = std::all_of(chars, chars + length, IsSingleCell) ? 1 : 0;
+        }
+        if (m_singleCellText == 0) {
+            cellWidth = 0;
+        }
+        
+        // Bold and italic fonts often keep the pitch. Only if one in the palette does
+        // not are the runs checked for whether it is actually used.
+        if (cellWidth > 0) {
+            bool samePitch = true;
+            for (const TextStyle& style : m_model.GetHighlighter().GetStyles()) {
+                if ((style.bold || style.italic) && GetCellWidth(style) != cellWidth) {
+                    samePitch = false;
                     break;
                 }
             }
-            
-            if (!alreadyMatched) {
-                wxString matchedText = m_text.Mid(start, length);
-                wxColour color = rule.colorFunc(matchedText);
-                segments.push_back({start, length, color});
-                
-                for (size_t i = start; i < start + length; i++) {
-                    matched[i] = true;
+            if (!samePitch) {
+                for (const auto& seg : m_model.GetStyledSegments()) {
+                    const TextStyle& style = m_model.GetStyle(seg.style);
+                    if ((style.bold || style.italic) && GetCellWidth(style) != cellWidth) {
+                        cellWidth = 0;
+                        break;
+                    }
                 }
             }
         }
-    }
-    
-    std::sort(segments.begin(), segments.end(),
-              [](const ColoredSegment& a, const ColoredSegment& b) {
-                  return a.start < b.start;
-              });
-    
-    std::vector<ColoredSegment> result;
-    size_t pos = 0;
-    
-    for (const auto& seg : segments) {
-        if (pos < seg.start) {
-            result.push_back({pos, seg.start - pos, m_defaultTextColor});
+        
+        if (cellWidth > 0) {
+            m_layout.Build(length, cellWidth);
+            return m_layout;
+        }
+        
+        // Bold and italic runs are wider than the regular font, so measure them separately
+        wxString text = m_model.GetValue();
+        std::vector<TextLayout::FontRun> runs;
+        for (const auto& seg : m_model.GetStyledSegments()) {
+            const TextStyle& style = m_model.GetStyle(seg.style);
+            if (!style.bold && !style.italic) continue;
+            
+            const wxFont* font = &GetStyleFont(style);
+            if (!runs.empty() && runs.back().font == font && runs.back().start + runs.back().length == seg.start) {
+                runs.back().length += seg.length;
+            } else {
+                runs.push_back({seg.start, seg.length, font});
+            }
+        }
+        
+        wxClientDC dc(this);
+        dc.SetFont(m_font);
+        if (runs.empty()) {
+            m_layout.Build(dc, text);
+        } else {
+            m_layout.Build(dc, text, runs);
         }
-        result.push_back(seg);
-        pos = seg.start + seg.length;
     }
-    
-    if (pos < m_text.length()) {
-        result.push_back({pos, m_text.length() - pos, m_defaultTextColor});
+    return m_layout;
+}
+
+void SyntaxTextCtrl::ResetStyleFonts() {
+    for (int i = 0; i < 8; i++) {
+        m_styleFonts[i] = wxNullFont;
+        m_cellWidths[i] = -1;
     }
-    
-    return result;
 }
+
+const wxFont& SyntaxTextCtrl::GetStyleFont(const TextStyle& style) {
+    int i = (style.bold ? 1 : 0) | (style.italic ? 2 : 0) | (style.underline ? 4 : 0);
+    wxFont& font = m_styleFonts[i];
+    if (!font.IsOk()) {
+        font = m_font;
+        if (i & 1) font = font.Bold();
+        if (i & 2) font = font.Italic();
+        if (i & 4) font = font.Underlined();
+    }
+    return font;
+}
+
+double SyntaxTextCtrl::GetCellWidth(const TextStyle& style) {
+    double& cellWidth = m_cellWidths[(style.bold ? 1 : 0) | (style.italic ? 2 : 0) | (style.underline ? 4 : 0)];
+    if (cellWidth < 0) {
+        // The narrowest and widest Latin letters only agree in a fixed-pitch font
+        const wxFont& font = GetStyleFont(style);
+        int narrow, wide, height;
+        GetTextExtent(wxString('i', PITCH_SAMPLE_LENGTH), &narrow, &height, nullptr, nullptr, &font);
+        GetTextExtent(wxString('W', PITCH_SAMPLE_LENGTH), &wide, &height, nullptr, nullptr, &font);
+        cellWidth = narrow == wide && narrow > 0 ? static_cast<double>(wide) / PITCH_SAMPLE_LENGTH : 0;
+    }
+    return cellWidth;
+}
+
+int SyntaxTextCtrl::GetLineHeight() const {
+    // Measured on first use, and again after UpdateControlHeight() when the font changes
+    if (m_lineHeight == 0) {
+        int width;
+        GetTextExtent("Ag", &width, &m_lineHeight, nullptr, nullptr, &m_font);
+    }
+    return m_lineHeight;
+}
+
+wxSize SyntaxTextCtrl::DoGetBestSize() const {
+    return wxSize(100, m_topMargin * 2 + GetLineHeight() + 4);
+}
+
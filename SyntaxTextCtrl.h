@@ -27,52 +27,99 @@
 
 #include <wx/wx.h>
 #include <wx/control.h>
-#include <wx/listbox.h>
+#include <wx/vlbox.h>
 #include <wx/popupwin.h>
 #include <vector>
 #include <string>
-#include <regex>
-#include <functional>
-#include <deque>
-
-using ColorFunc = std::function<wxColour(const wxString&)>;
+#include <memory>
+#include <chrono>
+#include "SyntaxTextModel.h"
+#include "CompletionProvider.h"
+#include "HighlightWorker.h"
+#include "PerfCounters.h"
 
 /**
- * Lambda type for completion suggestions
- * @param text The text to complete
- * @return A vector of completion suggestions
+ * Horizontal layout of a single line of text for one font
+ *
+ * Holds the pixel advance of every caret position, measured once with
+ * GetPartialTextExtents so kerning is accounted for. Positioning and hit
+ * testing are then answered from the table without touching a DC.
+ *
+ * Text in a fixed-pitch font can instead be laid out from the character
+ * width alone, which needs no measuring and no table.
  */
-using CompletionFunc = std::function<std::vector<wxString>(const wxString&)>;
+class TextLayout {
+public:
+    /** A range of the text drawn in a font other than the DC's */
+    struct FontRun {
+        size_t start;
+        size_t length;
+        const wxFont* font;
+    };
+    
+    TextLayout() : m_cellWidth(0), m_length(0), m_valid(false) {}
+    
+    void Build(const wxDC& dc, const wxString& text);
+    /** Measures each run in its own font; kerning across run edges is not accounted for */
+    void Build(wxDC& dc, const wxString& text, const std::vector<FontRun>& runs);
+    /** Lays out @p length characters that are each @p cellWidth pixels wide */
+    void Build(size_t length, double cellWidth);
+    void Invalidate() { m_valid = false; }
+    bool IsValid() const { return m_valid; }
+    
+    /** @return The x offset of the caret position @p pos, relative to the start of the text */
+    int GetX(size_t pos) const;
+    /** @return The caret position nearest to the x offset @p x */
+    size_t GetPosFromX(int x) const;
+    int GetWidth() const { return m_cellWidth > 0 ? GetX(m_length) : m_advances.back(); }
+    
+private:
+    // m_advances[i] is the width of the first i characters, unused for fixed pitch
+    std::vector<int> m_advances{0};
+    double m_cellWidth;  // 0 unless laid out with a fixed pitch
+    size_t m_length;
+    bool m_valid;
+};
+
+
+class SyntaxTextCtrl;
 
 /**
- * Structure to hold syntax highlighting rules
- * @param pattern The regex pattern to match
- * @param colorFunc The function to color the matched text
+ * Virtual list of completion candidates
+ *
+ * Rows are drawn straight from the candidate vector, so only the visible ones are
+ * ever measured or rendered and updating the list does not depend on its length.
  */
-struct SyntaxRule {
-    std::wregex pattern;
-    ColorFunc colorFunc;
+class CompletionListBox : public wxVListBox {
+public:
+    CompletionListBox(wxWindow* parent);
+    
+    void SetItems(std::vector<wxString> items);
+    const wxString& GetItem(size_t n) const { return m_items[n]; }
+    size_t GetCount() const { return m_items.size(); }
     
-    SyntaxRule(const std::string& regexPattern, ColorFunc func)
-        : pattern(wxString::FromUTF8(regexPattern.c_str()).ToStdWstring()),
-          colorFunc(func) {}
+private:
+    std::vector<wxString> m_items;
+    
+    virtual void OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const override;
+    virtual wxCoord OnMeasureItem(size_t n) const override;
 };
 
-class SyntaxTextCtrl;
-
 class CompletionPopup : public wxPopupWindow {
 public:
     CompletionPopup(wxWindow* parent, SyntaxTextCtrl* textCtrl);
     
-    void SetCompletions(const std::vector<wxString>& completions);
+    void SetCompletions(std::vector<wxString> completions);
     wxString GetSelectedCompletion() const;
     bool SelectNext();
     bool SelectPrevious();
+    bool SelectNextPage();
+    bool SelectPreviousPage();
     int GetSelection() const { return m_listBox->GetSelection(); }
     bool HasCompletions() const { return m_listBox->GetCount() > 0; }
     
 private:
-    wxListBox* m_listBox;
+    CompletionListBox* m_listBox;
     SyntaxTextCtrl* m_textCtrl;
     
     void OnListBoxClick(wxCommandEvent& event);
@@ -81,6 +128,30 @@ private:
     void AcceptAndDismiss();
 };
 
+/**
+ * Timings collected by a SyntaxTextCtrl, see SyntaxTextCtrl::EnablePerfStats()
+ * @param paint Paint events, including composing the line from its cached tiles
+ * @param highlight Highlighting, with a breakdown by rule for SYNTAX_ENGINE_REGEX
+ * @param completion Synchronous completion calls, or for an asynchronous provider the
+ *                   time from submitting a request to its results arriving
+ * @param popup Filling and positioning the completion popup
+ * @param hitTest Mapping mouse positions to caret positions
+ * @param undoMemory Bytes held by the undo history when the stats were read
+ */
+struct SyntaxTextPerfStats {
+    LatencyHistogram paint;
+    HighlightPerfStats highlight;
+    LatencyHistogram completion;
+    LatencyHistogram popup;
+    LatencyHistogram hitTest;
+    size_t undoMemory;
+    
+    SyntaxTextPerfStats() : undoMemory(0) {}
+    
+    /** @return One line per counter with its count, p50, p99 and maximum */
+    wxString Format() const;
+};
+
 /**
  * @class SyntaxTextCtrl
  * @brief Custom single-line text input control with syntax highlighting and auto-completion for wxWidgets.
@@ -108,21 +179,106 @@ public:
     virtual ~SyntaxTextCtrl();
     
     void SetValue(const wxString& value);
-    wxString GetValue() const { return m_text; }
+    /**
+     * Replaces the text without recording an undo step, and clears the undo history
+     *
+     * Meant for filling forms: nothing is measured or highlighted until the control
+     * is painted.
+     */
+    void LoadValue(const wxString& value);
+    wxString GetValue() const { return m_model.GetValue(); }
+    
+    /** @return The text model the control displays */
+    const SyntaxTextModel& GetModel() const { return m_model; }
+    
+    /**
+     * Highlights with a compiled grammar, which may be shared with other controls
+     *
+     * Replaces the rules, the engine and the palette. Rules added afterwards only
+     * apply to this control.
+     */
+    void SetSyntaxGrammar(SyntaxGrammarPtr grammar);
     
     void AddSyntaxRule(const std::string& regexPattern, ColorFunc colorFunc);
+    /** Adds a rule that draws every match in the palette entry @p style, see AddSyntaxStyle() */
+    void AddSyntaxRule(const std::string& regexPattern, StyleId style);
+    /** Adds a rule whose function picks each match's style from a view of its text and groups */
+    void AddSyntaxRule(const std::string& regexPattern, StyleFunc styleFunc);
+    /** Adds a rule that styles capture groups separately, see SyntaxHighlighter::AddRule() */
+    void AddSyntaxRule(const std::string& regexPattern, const std::vector<GroupStyle>& groupStyles);
     void ClearSyntaxRules();
     
-    void SetCompletionFunction(CompletionFunc func);
+    /** @return The id of a new palette entry, or STYLE_DEFAULT if all 256 are in use */
+    StyleId AddSyntaxStyle(const TextStyle& style);
+    /** Changes a palette entry; STYLE_DEFAULT is the style of text no rule matches */
+    void SetSyntaxStyle(StyleId id, const TextStyle& style);
+    const TextStyle& GetSyntaxStyle(StyleId id) const { return m_model.GetStyle(id); }
+    
+    void SetSyntaxEngine(SyntaxEngine engine);
+    
+    /**
+     * Highlights on a worker thread instead of while painting
+     *
+     * Painting then uses the newest finished highlighting, moved along with the edits
+     * made since, so typing never waits for the rules. Edited text is unstyled until
+     * the worker catches up. Grammars with a ColorFunc rule are still highlighted on
+     * the UI thread; StyleFuncs are called on the worker thread.
+     */
+    void SetBackgroundHighlighting(bool enable);
+    bool IsBackgroundHighlighting() const { return (bool)m_highlightWorker; }
+    
+    /**
+     * Sets the time each rule may take per highlighting pass, 0 for no limit
+     *
+     * A rule over budget is skipped and its text drawn in the default style, and backs
+     * off for longer while it keeps failing, so one bad pattern cannot freeze painting.
+     * Rules only std::regex can match are checked between matches alone, see
+     * SyntaxHighlighter.
+     */
+    void SetSyntaxMatchBudget(int milliseconds);
+    /**
+     * Sets a function told which rule exceeded the match budget, and on what text
+     *
+     * With background highlighting it is called on the worker thread.
+     */
+    void SetSyntaxBudgetExceededFunction(BudgetExceededFunc func);
+    
+    /**
+     * Sets the completion provider, called with the text before the caret
+     *
+     * Results are cached by that text. If @p prefixFilterable is set, the results for
+     * a longer word must be exactly those for a shorter one that start with the longer
+     * word; typing on in a word then narrows the cached list instead of calling again.
+     */
+    void SetCompletionFunction(CompletionFunc func, bool prefixFilterable = false);
+    
+    /**
+     * Sets a completion provider that runs on a worker thread
+     *
+     * Requests are debounced, superseded requests are cancelled and only the result for
+     * the current text is shown. Replaces any function set with SetCompletionFunction().
+     * Results are cached as for SetCompletionFunction().
+     */
+    void SetAsyncCompletionFunction(AsyncCompletionFunc func, bool prefixFilterable = false);
+    /** Forgets cached completions, e.g. because the provider's data changed */
+    void ClearCompletionCache() { m_completionCache.Clear(); }
+    /** Sets how long typing must pause before an asynchronous request is made, 0 to disable */
+    void SetCompletionDelay(int milliseconds) { m_completionDelay = milliseconds; }
+    int GetCompletionDelay() const { return m_completionDelay; }
+    
+    /** Sets what counts as a word for Ctrl+Left/Right and Ctrl+Backspace/Delete */
+    void SetWordBoundaries(WordBoundaryMode mode) { m_model.SetWordBoundaries(mode); }
     
     void SetSelection(long from, long to);
     void GetSelection(long* from, long* to) const;
-    bool HasSelection() const { return m_selectionStart != m_selectionEnd; }
+    bool HasSelection() const { return m_model.HasSelection(); }
     
     void Undo();
     void Redo();
-    bool CanUndo() const { return !m_undoStack.empty(); }
-    bool CanRedo() const { return !m_redoStack.empty(); }
+    bool CanUndo() const { return m_model.CanUndo(); }
+    bool CanRedo() const { return m_model.CanRedo(); }
+    /** Caps the memory held by the undo history, in bytes */
+    void SetUndoMemoryLimit(size_t bytes) { m_model.SetUndoMemoryLimit(bytes); }
     
     void SetTextFont(const wxFont& font);
     void SetTextFont(int pointSize, wxFontFamily family = wxFONTFAMILY_TELETYPE,
@@ -134,29 +290,30 @@ public:
     int GetFontSize() const { return m_font.GetPointSize(); }
     wxFontFamily GetFontFamily() const { return m_font.GetFamily(); }
     
-private:
-    // Text state
-    wxString m_text;
-    size_t m_cursorPos;
-    size_t m_selectionStart;
-    size_t m_selectionEnd;
+    /**
+     * Starts or stops collecting timings; while stopped, no clock is read
+     * @param logInterval If positive, the stats are also written every this many
+     *                    milliseconds with wxLogTrace, under the "SyntaxTextCtrl" mask
+     */
+    void EnablePerfStats(bool enable, int logInterval = 0);
+    bool IsPerfStatsEnabled() const { return m_perfEnabled; }
+    const SyntaxTextPerfStats& GetPerfStats();
+    void ResetPerfStats();
     
-    // Syntax highlighting
-    std::vector<SyntaxRule> m_syntaxRules;
+private:
+    // Text, caret, selection, highlighting and undo history
+    SyntaxTextModel m_model;
     
     // Completion
     CompletionFunc m_completionFunc;
     CompletionPopup* m_completionPopup;
     bool m_showingCompletions;
-    
-    // Undo/Redo
-    struct TextState {
-        wxString text;
-        size_t cursorPos;
-    };
-    std::deque<TextState> m_undoStack;
-    std::deque<TextState> m_redoStack;
-    static const size_t MAX_UNDO_LEVELS = 100;
+    std::unique_ptr<CompletionWorker> m_completionWorker;
+    wxTimer* m_completionTimer;  // Debounces asynchronous requests
+    int m_completionDelay;
+    unsigned long m_completionGeneration;
+    wxString m_completionRequestText;  // The text the pending asynchronous request is for
+    CompletionCache m_completionCache;
     
     // Rendering
     wxFont m_font;
@@ -166,50 +323,125 @@ private:
     wxColour m_cursorColor;
     int m_leftMargin;
     int m_topMargin;
+    TextLayout m_layout;
+    wxFont m_styleFonts[8];  // m_font with every combination of bold, italic and underline, made on first use
+    double m_cellWidths[8];  // Character width of each style font, 0 if proportional, -1 until measured
     
-    // Cursor blinking
-    wxTimer* m_cursorTimer;
+    // Cursor blinking, driven by the timer shared by all controls
+    friend class CaretBlinker;
     bool m_cursorVisible;
     
     int m_scrollOffset;  // Horizontal scroll position in pixels
     
+    /**
+     * A stretch of the rendered line, in line coordinates
+     *
+     * Tiles depend only on the text, styles and font. The selected variant is drawn on
+     * the selection color and is only rendered once a selection covers the tile.
+     */
+    struct LineTile {
+        wxBitmap normal;
+        wxBitmap selected;
+    };
+    std::vector<LineTile> m_tiles;
+    size_t m_renderedTiles;
+    
+    // The viewport as last composed from tiles, without the caret, and the state it was composed for
+    wxBitmap m_lineBitmap;
+    bool m_lineCacheValid;
+    size_t m_cachedSelectionStart;
+    size_t m_cachedSelectionEnd;
+    int m_cachedScrollOffset;
+    mutable int m_lineHeight;  // Of m_font, 0 until measured
+    int m_singleCellText;      // 1 if every character fits a fixed-pitch cell, 0 if not, -1 until checked
+    
     void OnPaint(wxPaintEvent& event);
+    void RenderLine(const wxSize& size);
+    bool IsLineCacheValid(const wxSize& size) const;
+    void BlitTiles(wxDC& dc, int from, int to, bool selected);
+    wxBitmap& GetTile(size_t index, bool selected);
+    void RenderTile(wxBitmap& tile, size_t index, bool selected);
+    void InvalidateLine();
+    void ReleaseTiles();
+    wxRect GetCaretRect();
     void OnChar(wxKeyEvent& event);
     void OnKeyDown(wxKeyEvent& event);
     void OnMouseDown(wxMouseEvent& event);
     void OnMouseMove(wxMouseEvent& event);
     void OnMouseUp(wxMouseEvent& event);
+    void OnMouseCaptureLost(wxMouseCaptureLostEvent& event);
+    void OnDragTimer(wxTimerEvent& event);
+    bool UpdateDrag();
+    void EndDrag();
     void OnSetFocus(wxFocusEvent& event);
     void OnKillFocus(wxFocusEvent& event);
     void OnSize(wxSizeEvent& event);
-    void OnCursorTimer(wxTimerEvent& event);
+    void OnShow(wxShowEvent& event);
+    void OnIdle(wxIdleEvent& event);
+    void OnPerfLogTimer(wxTimerEvent& event);
+    void UpdateBackgroundHighlighting();
+    void OnHighlightReady(HighlightResult result);
+    LatencyHistogram* GetPerfCounter(LatencyHistogram& histogram) { return m_perfEnabled ? &histogram : nullptr; }
+    void OnCompletionTimer(wxTimerEvent& event);
     
-    void InsertText(const wxString& text);
-    void DeleteSelection();
-    void DeleteChar(bool forward);
     void MoveCursor(int delta, bool select);
     void SetCursorPos(size_t pos, bool select);
+    void CursorMoved();
+    void MarkDirty(int flags);
+    void ResolveDirty();
+    /** Resolves the caret and paint flags without repainting; @return true if the view changed */
+    bool ResolveView();
     size_t GetCursorPosFromPoint(const wxPoint& point);
     wxPoint GetPointFromCursorPos(size_t pos);
     void CopyToClipboard();
     void PasteFromClipboard();
     void SelectAll();
-    void SaveUndoState();
     void UpdateCompletions();
-    void ShowCompletions(const std::vector<wxString>& completions);
+    void RequestCompletions();
+    void OnCompletionsReady(unsigned long generation, std::vector<wxString> completions);
+    void ShowCompletions(std::vector<wxString> completions);
     void HideCompletions();
     void AcceptCompletion();
     void EnsureCursorVisible();
     void UpdateControlHeight();
+    void MarkTextChanged(size_t pos, size_t removed, size_t inserted);
+    const TextLayout& GetTextLayout();
+    void ResetStyleFonts();
+    const wxFont& GetStyleFont(const TextStyle& style);
+    double GetCellWidth(const TextStyle& style);
+    int GetLineHeight() const;
+    virtual wxSize DoGetBestSize() const override;
     
-    struct ColoredSegment {
-        size_t start;
-        size_t length;
-        wxColour color;
+    // Drag selection, coalesced to one hit-test per frame
+    bool m_dragging;
+    bool m_dragPending;   // m_dragPoint moved since it was last hit-tested
+    wxPoint m_dragPoint;  // Latest pointer position, in client coordinates
+    wxTimer* m_dragTimer;
+    
+    /**
+     * What changed since the last frame
+     *
+     * Mutations only mark the state they changed. Scrolling the caret into view,
+     * updating completions and repainting happen once, on the next idle tick or paint,
+     * however many edits arrived in between.
+     */
+    enum DirtyFlags {
+        DIRTY_PAINT = 1 << 0,        // Text, styling, selection or scroll position changed
+        DIRTY_CARET = 1 << 1,        // The caret moved, so it is scrolled into view and shown
+        DIRTY_COMPLETIONS = 1 << 2   // Text was typed, completions are updated for it
     };
-    std::vector<ColoredSegment> GetColoredSegments() const;
+    int m_dirty;
     
-    bool m_dragging;
+    // Background highlighting: the grammar and text revision last submitted
+    std::unique_ptr<HighlightWorker> m_highlightWorker;
+    SyntaxGrammarPtr m_highlightGrammar;
+    unsigned long m_highlightRevision;
+    
+    // Performance counters
+    bool m_perfEnabled;
+    SyntaxTextPerfStats m_perfStats;
+    wxTimer* m_perfLogTimer;
+    std::chrono::steady_clock::time_point m_completionRequested;
     
     wxDECLARE_EVENT_TABLE();
 };
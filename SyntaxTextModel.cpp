@@ -0,0 +1,357 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "SyntaxTextModel.h"
+
+SyntaxTextModel::SyntaxTextModel(const wxString& value)
+    : m_text(value),
+      m_cursorPos(0),
+      m_selectionStart(0),
+      m_selectionEnd(0),
+      m_revision(0),
+      m_externalHighlighting(false),
+      m_externalSegmentsValid(false),
+      m_externalRevision(0),
+      m_wordBoundaries(WORD_BOUNDARY_WHITESPACE) {
+}
+
+void SyntaxTextModel::SetValue(const wxString& value) {
+    BeginEdit(UndoJournal::EDIT_OTHER);
+    ReplaceText(0, m_text.GetLength(), value);
+    m_cursorPos = m_text.GetLength();
+    CollapseSelection();
+}
+
+void SyntaxTextModel::LoadValue(const wxString& value) {
+    m_undoJournal.Clear();
+    ReplaceText(0, m_text.GetLength(), value, false);
+    m_cursorPos = m_text.GetLength();
+    CollapseSelection();
+}
+
+wxString SyntaxTextModel::GetSelectedText() const {
+    return m_text.Mid(GetSelectionStart(), GetSelectionEnd() - GetSelectionStart());
+}
+
+void SyntaxTextModel::SetSelection(size_t from, size_t to) {
+    m_undoJournal.BreakCoalescing();
+    m_selectionStart = std::min(from, m_text.GetLength());
+    m_selectionEnd = std::min(to, m_text.GetLength());
+    m_cursorPos = m_selectionEnd;
+}
+
+void SyntaxTextModel::SelectAll() {
+    SetSelection(0, m_text.GetLength());
+}
+
+void SyntaxTextModel::SetCursorPos(size_t pos, bool select) {
+    m_undoJournal.BreakCoalescing();
+    
+    m_cursorPos = GetBoundaries().GetGraphemeStart(pos);
+    
+    if (!select) {
+        m_selectionStart = m_cursorPos;
+    }
+    m_selectionEnd = m_cursorPos;
+}
+
+void SyntaxTextModel::MoveCursor(int delta, bool select) {
+    m_undoJournal.BreakCoalescing();
+    
+    if (!select && HasSelection() && delta != 0) {
+        m_cursorPos = delta < 0 ? GetSelectionStart() : GetSelectionEnd();
+        CollapseSelection();
+        return;
+    }
+    
+    const TextBoundaryIndex& boundaries = GetBoundaries();
+    size_t newPos = m_cursorPos;
+    for (; delta > 0 && newPos < m_text.GetLength(); delta--) {
+        newPos = boundaries.GetNextGrapheme(newPos);
+    }
+    for (; delta < 0 && newPos > 0; delta++) {
+        newPos = boundaries.GetPreviousGrapheme(newPos);
+    }
+    SetCursorPos(newPos, select);
+}
+
+void SyntaxTextModel::MoveCursorByWord(bool forward, bool select) {
+    const TextBoundaryIndex& boundaries = GetBoundaries();
+    SetCursorPos(forward ? boundaries.GetNextWordStart(m_cursorPos)
+                         : boundaries.GetPreviousWordStart(m_cursorPos), select);
+}
+
+void SyntaxTextModel::SetWordBoundaries(WordBoundaryMode mode) {
+    m_wordBoundaries = mode;
+    m_boundaries.Invalidate();
+}
+
+void SyntaxTextModel::WriteText(const wxString& text, UndoJournal::EditKind kind) {
+    BeginEdit(kind);
+    
+    size_t start = GetSelectionStart();
+    ReplaceText(start, GetSelectionEnd() - start, text);
+    m_cursorPos = start + text.length();
+    CollapseSelection();
+}
+
+bool SyntaxTextModel::Delete(bool forward) {
+    if (HasSelection()) {
+        return DeleteRange(GetSelectionStart(), GetSelectionEnd());
+    }
+    
+    const TextBoundaryIndex& boundaries = GetBoundaries();
+    if (forward) {
+        return DeleteRange(m_cursorPos, boundaries.GetNextGrapheme(m_cursorPos));
+    }
+    return DeleteRange(boundaries.GetPreviousGrapheme(m_cursorPos), m_cursorPos);
+}
+
+bool SyntaxTextModel::DeleteWord(bool forward) {
+    if (HasSelection()) {
+        return DeleteRange(GetSelectionStart(), GetSelectionEnd());
+    }
+    
+    const TextBoundaryIndex& boundaries = GetBoundaries();
+    if (forward) {
+        return DeleteRange(m_cursorPos, boundaries.GetNextWordStart(m_cursorPos));
+    }
+    return DeleteRange(boundaries.GetPreviousWordStart(m_cursorPos), m_cursorPos);
+}
+
+void SyntaxTextModel::ReplaceWordBeforeCursor(const wxString& text) {
+    size_t wordStart = GetBoundaries().GetCompletionWordStart(m_cursorPos);
+    
+    BeginEdit(UndoJournal::EDIT_OTHER);
+    ReplaceText(wordStart, m_cursorPos - wordStart, text);
+    m_cursorPos = wordStart + text.length();
+    CollapseSelection();
+}
+
+bool SyntaxTextModel::Undo() {
+    const UndoJournal::Step* step = m_undoJournal.Undo();
+    if (!step) return false;
+    
+    for (auto it = step->deltas.rbegin(); it != step->deltas.rend(); ++it) {
+        ReplaceText(it->pos, it->inserted.length(), it->removed, false);
+    }
+    m_cursorPos = step->cursorBefore;
+    CollapseSelection();
+    return true;
+}
+
+bool SyntaxTextModel::Redo() {
+    const UndoJournal::Step* step = m_undoJournal.Redo();
+    if (!step) return false;
+    
+    for (const auto& delta : step->deltas) {
+        ReplaceText(delta.pos, delta.removed.length(), delta.inserted, false);
+    }
+    const UndoJournal::Delta& last = step->deltas.back();
+    m_cursorPos = last.pos + last.inserted.length();
+    CollapseSelection();
+    return true;
+}
+
+void SyntaxTextModel::SetDefaultColor(const wxColour& color) {
+    TextStyle style = m_highlighter.GetStyle(STYLE_DEFAULT);
+    style.foreground = color;
+    m_highlighter.SetStyle(STYLE_DEFAULT, style);
+}
+
+const std::vector<StyledSegment>& SyntaxTextModel::GetStyledSegments() {
+    if (m_externalHighlighting) {
+        if (!m_externalSegmentsValid) {
+            BuildSegments(m_externalTokens);
+            m_externalSegmentsValid = true;
+        }
+        return m_segments;
+    }
+    
+    if (m_highlighter.IsUpToDate()) {
+        return m_segments;
+    }
+    
+    BuildSegments(m_highlighter.Update(m_text));
+    return m_segments;
+}
+
+void SyntaxTextModel::SetExternalHighlighting(bool enable) {
+    if (enable == m_externalHighlighting) return;
+    
+    m_externalHighlighting = enable;
+    m_externalSegmentsValid = false;
+    m_externalEdits.clear();
+    m_externalRevision = m_revision;
+    m_externalTokens.clear();
+    m_boundaries.Invalidate();
+    
+    // Start from the current highlighting if it is at hand, rather than from plain text
+    if (enable && m_highlighter.IsUpToDate()) {
+        m_externalTokens = m_highlighter.Update(m_text);
+    }
+    
+    // Switching back, the synchronous highlighter must not reuse segments built from the external tokens
+    if (!enable) {
+        m_highlighter.Invalidate();
+    }
+}
+
+void SyntaxTextModel::SetHighlightResult(unsigned long revision, const std::vector<StyledSegment>& tokens) {
+    if (!m_externalHighlighting || revision < m_externalRevision || revision > m_revision) return;
+    
+    // Replay the edits made since the snapshot was taken
+    auto newer = std::find_if(m_externalEdits.begin(), m_externalEdits.end(),
+                              [revision](const Edit& edit) { return edit.revision > revision; });
+    m_externalEdits.erase(m_externalEdits.begin(), newer);
+    
+    m_externalTokens = tokens;
+    for (const auto& edit : m_externalEdits) {
+        ShiftTokens(m_externalTokens, edit);
+    }
+    m_externalRevision = revision;
+    m_externalSegmentsValid = false;
+    if (m_wordBoundaries == WORD_BOUNDARY_TOKENS) {
+        m_boundaries.Invalidate();
+    }
+}
+
+void SyntaxTextModel::ShiftTokens(std::vector<StyledSegment>& tokens, const Edit& edit) {
+    size_t editEnd = edit.pos + edit.removed;
+    long delta = (long)edit.inserted - (long)edit.removed;
+    
+    // Tokens keep their text outside the replaced range; what was replaced is unstyled
+    std::vector<StyledSegment> shifted;
+    shifted.reserve(tokens.size() + 1);
+    for (const auto& token : tokens) {
+        size_t start = token.start;
+        size_t end = token.start + token.length;
+        
+        if (start < edit.pos) {
+            size_t before = std::min(end, edit.pos);
+            shifted.push_back({token.start, (uint16_t)(before - start), token.style});
+        }
+        if (end > editEnd) {
+            size_t after = std::max(start, editEnd);
+            shifted.push_back({(uint32_t)((long)after + delta), (uint16_t)(end - after), token.style});
+        }
+    }
+    tokens.swap(shifted);
+}
+
+void SyntaxTextModel::BuildSegments(const std::vector<StyledSegment>& tokens) {
+    m_segments.clear();
+    size_t pos = 0;
+    
+    for (const auto& seg : tokens) {
+        AppendSegment(pos, seg.start - pos, STYLE_DEFAULT);
+        AppendSegment(seg.start, seg.length, seg.style);
+        pos = seg.start + seg.length;
+    }
+    AppendSegment(pos, m_text.GetLength() - pos, STYLE_DEFAULT);
+}
+
+void SyntaxTextModel::BeginEdit(UndoJournal::EditKind kind) {
+    // Replacing a selection never continues the previous run of typing
+    if (HasSelection()) {
+        m_undoJournal.BreakCoalescing();
+    }
+    m_undoJournal.BeginStep(kind, m_cursorPos);
+}
+
+void SyntaxTextModel::ReplaceText(size_t pos, size_t length, const wxString& text, bool record) {
+    if (record) {
+        m_undoJournal.Record(pos, m_text.Mid(pos, length), text);
+    }
+    m_text.Replace(pos, length, text);
+    m_highlighter.NoteEdit(pos, length, text.length());
+    m_boundaries.Invalidate();
+    m_revision++;
+    
+    if (m_externalHighlighting) {
+        Edit edit = {m_revision, pos, length, text.length()};
+        m_externalEdits.push_back(edit);
+        ShiftTokens(m_externalTokens, edit);
+        m_externalSegmentsValid = false;
+    }
+    
+    if (m_onChange) {
+        m_onChange(pos, length, text.length());
+    }
+}
+
+void SyntaxTextModel::CollapseSelection() {
+    m_selectionStart = m_cursorPos;
+    m_selectionEnd = m_cursorPos;
+}
+
+bool SyntaxTextModel::DeleteRange(size_t from, size_t to) {
+    if (from >= to) return false;
+    
+    BeginEdit(UndoJournal::EDIT_DELETE);
+    ReplaceText(from, to - from, wxEmptyString);
+    m_cursorPos = from;
+    CollapseSelection();
+    return true;
+}
+
+const TextBoundaryIndex& SyntaxTextModel::GetBoundaries() {
+    std::vector<TextBoundaryIndex::Span> spans;
+    
+    if (m_wordBoundaries == WORD_BOUNDARY_TOKENS) {
+        // Token edges move whenever the rules change, not only when the text does
+        if (!m_externalHighlighting && !m_highlighter.IsUpToDate()) {
+            m_boundaries.Invalidate();
+        }
+        if (!m_boundaries.IsValid()) {
+            GetStyledSegments();
+            const std::vector<StyledSegment>& tokens =
+                m_externalHighlighting ? m_externalTokens : m_highlighter.Update(m_text);
+            for (const auto& token : tokens) {
+                spans.push_back({token.start, token.length});
+            }
+        }
+    }
+    
+    if (!m_boundaries.IsValid()) {
+        m_boundaries.Build(m_text, m_wordBoundaries, spans);
+    }
+    return m_boundaries;
+}
+
+void SyntaxTextModel::AppendSegment(size_t start, size_t length, StyleId style) {
+    if (length == 0) return;
+    
+    // Extend the previous run when it has the same style, so the view draws fewer pieces
+    if (!m_segments.empty()) {
+        StyledSegment& last = m_segments.back();
+        if (last.style == style && last.start + last.length == start) {
+            size_t grow = std::min(length, STYLED_SEGMENT_MAX_LENGTH - last.length);
+            last.length = (uint16_t)(last.length + grow);
+            start += grow;
+            length -= grow;
+        }
+    }
+    SyntaxHighlighter::AppendSegment(m_segments, start, length, style);
+}
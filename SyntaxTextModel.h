@@ -0,0 +1,192 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SYNTAX_TEXT_MODEL_H
+#define SYNTAX_TEXT_MODEL_H
+
+#include <wx/string.h>
+#include <wx/colour.h>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include "SyntaxHighlighter.h"
+#include "UndoJournal.h"
+#include "TextBuffer.h"
+#include "TextBoundaryIndex.h"
+
+/**
+ * Display-independent state of a single-line editor
+ *
+ * Holds the text, caret and selection, applies edits with undo history and keeps the
+ * syntax highlighting up to date. SyntaxTextCtrl is a view over a model; a model can
+ * also be used on its own, for example to edit or highlight text on a machine without
+ * a display. It uses wxString and wxColour but no windows or device contexts.
+ *
+ * The selection runs from an anchor to the caret; it is empty when they coincide.
+ */
+class SyntaxTextModel {
+public:
+    /**
+     * Lambda type for change notifications
+     * @param pos The start of the replaced range
+     * @param removed The number of characters removed at @p pos
+     * @param inserted The number of characters inserted in their place
+     */
+    using ChangeFunc = std::function<void(size_t pos, size_t removed, size_t inserted)>;
+    
+    explicit SyntaxTextModel(const wxString& value = wxEmptyString);
+    
+    /** Replaces the whole text as one undoable step and moves the caret to the end */
+    void SetValue(const wxString& value);
+    /** Replaces the whole text without recording an undo step, and clears the undo history */
+    void LoadValue(const wxString& value);
+    wxString GetValue() const { return m_text.ToString(); }
+    size_t GetLength() const { return m_text.GetLength(); }
+    /** @return Up to @p length characters starting at @p pos */
+    wxString GetRange(size_t pos, size_t length) const { return m_text.Mid(pos, length); }
+    /** @return The characters [from, to) in place, valid until the text next changes */
+    const wchar_t* GetView(size_t from, size_t to) { return m_text.GetView(from, to); }
+    
+    /** Sets the function called after every change to the text */
+    void SetChangeFunction(ChangeFunc func) { m_onChange = func; }
+    
+    size_t GetCursorPos() const { return m_cursorPos; }
+    size_t GetSelectionStart() const { return std::min(m_selectionStart, m_selectionEnd); }
+    size_t GetSelectionEnd() const { return std::max(m_selectionStart, m_selectionEnd); }
+    bool HasSelection() const { return m_selectionStart != m_selectionEnd; }
+    wxString GetSelectedText() const;
+    
+    /** Selects [from, to) with the caret at @p to; both are clamped to the text */
+    void SetSelection(size_t from, size_t to);
+    void SelectAll();
+    /** Moves the caret to @p pos, extending the selection if @p select is set */
+    void SetCursorPos(size_t pos, bool select);
+    /** Moves the caret by @p delta grapheme clusters. Without @p select, a selection collapses to its edge. */
+    void MoveCursor(int delta, bool select);
+    /** Moves the caret to the start of the previous or the next word */
+    void MoveCursorByWord(bool forward, bool select);
+    
+    /** Sets what counts as a word for MoveCursorByWord() and DeleteWord() */
+    void SetWordBoundaries(WordBoundaryMode mode);
+    WordBoundaryMode GetWordBoundaries() const { return m_wordBoundaries; }
+    
+    /**
+     * Replaces the selection with @p text and places the caret after it
+     * @param kind EDIT_TYPING lets consecutive calls coalesce into one undo step
+     */
+    void WriteText(const wxString& text, UndoJournal::EditKind kind = UndoJournal::EDIT_OTHER);
+    /**
+     * Deletes the selection, or else the grapheme cluster after or before the caret
+     * @return false if there was nothing to delete
+     */
+    bool Delete(bool forward);
+    /**
+     * Deletes the selection, or else up to the caret position MoveCursorByWord() would reach
+     * @return false if there was nothing to delete
+     */
+    bool DeleteWord(bool forward);
+    
+    /** @return The text up to the caret, as passed to completion functions */
+    wxString GetTextBeforeCursor() const { return m_text.Mid(0, m_cursorPos); }
+    /** Replaces the word before the caret, i.e. everything after the last space, with @p text */
+    void ReplaceWordBeforeCursor(const wxString& text);
+    
+    bool Undo();
+    bool Redo();
+    bool CanUndo() const { return m_undoJournal.CanUndo(); }
+    bool CanRedo() const { return m_undoJournal.CanRedo(); }
+    void SetUndoMemoryLimit(size_t bytes) { m_undoJournal.SetBudget(bytes); }
+    size_t GetUndoMemoryUsage() const { return m_undoJournal.GetMemoryUsage(); }
+    
+    SyntaxHighlighter& GetHighlighter() { return m_highlighter; }
+    const TextStyle& GetStyle(StyleId id) const { return m_highlighter.GetStyle(id); }
+    /** Sets the color of text no rule matches, i.e. of STYLE_DEFAULT */
+    void SetDefaultColor(const wxColour& color);
+    
+    /**
+     * @return Runs covering the whole text, sorted by position. Text no rule matches is
+     *         given STYLE_DEFAULT, and neighbouring runs of the same style are merged.
+     */
+    const std::vector<StyledSegment>& GetStyledSegments();
+    
+    /** @return A number that grows with every change to the text */
+    unsigned long GetRevision() const { return m_revision; }
+    
+    /**
+     * Lets the highlighting be computed elsewhere, e.g. by a HighlightWorker
+     *
+     * While enabled, GetStyledSegments() never runs the rules. It uses the newest
+     * tokens passed to SetHighlightResult(), moved along with the edits made since
+     * their revision; edited text stays unstyled until a newer result covers it.
+     */
+    void SetExternalHighlighting(bool enable);
+    bool IsExternalHighlighting() const { return m_externalHighlighting; }
+    /**
+     * Takes the tokens highlighted for the text at @p revision, see GetRevision()
+     *
+     * Results older than the one already held are ignored.
+     */
+    void SetHighlightResult(unsigned long revision, const std::vector<StyledSegment>& tokens);
+    
+private:
+    TextBuffer m_text;
+    size_t m_cursorPos;
+    size_t m_selectionStart;  // Anchor
+    size_t m_selectionEnd;    // Follows the caret
+    
+    UndoJournal m_undoJournal;
+    SyntaxHighlighter m_highlighter;
+    std::vector<StyledSegment> m_segments;
+    unsigned long m_revision;
+    
+    // Highlighting computed elsewhere, and the edits made since its revision
+    struct Edit {
+        unsigned long revision;  // The revision the edit produced
+        size_t pos;
+        size_t removed;
+        size_t inserted;
+    };
+    bool m_externalHighlighting;
+    bool m_externalSegmentsValid;
+    unsigned long m_externalRevision;
+    std::vector<StyledSegment> m_externalTokens;  // Already moved along with m_externalEdits
+    std::vector<Edit> m_externalEdits;
+    
+    // Caret stops and word starts of the current text, rebuilt on first use after an edit
+    TextBoundaryIndex m_boundaries;
+    WordBoundaryMode m_wordBoundaries;
+    
+    ChangeFunc m_onChange;
+    
+    void BeginEdit(UndoJournal::EditKind kind);
+    void ReplaceText(size_t pos, size_t length, const wxString& text, bool record = true);
+    void CollapseSelection();
+    bool DeleteRange(size_t from, size_t to);
+    void AppendSegment(size_t start, size_t length, StyleId style);
+    void BuildSegments(const std::vector<StyledSegment>& tokens);
+    static void ShiftTokens(std::vector<StyledSegment>& tokens, const Edit& edit);
+    const TextBoundaryIndex& GetBoundaries();
+};
+
+#endif // SYNTAX_TEXT_MODEL_H
@@ -0,0 +1,189 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TextBoundaryIndex.h"
+#include <algorithm>
+#include <cwctype>
+#include <cwchar>
+
+namespace {
+
+enum CharClass { CHAR_SPACE, CHAR_WORD, CHAR_OTHER };
+
+bool IsHighSurrogate(unsigned c) { return c >= 0xD800 && c <= 0xDBFF; }
+bool IsLowSurrogate(unsigned c) { return c >= 0xDC00 && c <= 0xDFFF; }
+bool IsRegionalIndicator(unsigned c) { return c >= 0x1F1E6 && c <= 0x1F1FF; }
+
+// Marks that attach to the preceding character: the common combining blocks,
+// variation selectors, emoji skin tone modifiers and tags
+bool IsExtender(unsigned c) {
+    return (c >= 0x0300 && c <= 0x036F) ||
+           (c >= 0x0483 && c <= 0x0489) ||
+           (c >= 0x0591 && c <= 0x05BD) ||
+           (c >= 0x0610 && c <= 0x061A) ||
+           (c >= 0x064B && c <= 0x065F) ||
+           (c >= 0x0900 && c <= 0x0903) ||
+           (c >= 0x093A && c <= 0x094F) ||
+           (c >= 0x1160 && c <= 0x11FF) ||
+           (c >= 0x1AB0 && c <= 0x1AFF) ||
+           (c >= 0x1DC0 && c <= 0x1DFF) ||
+           c == 0x200C || c == 0x200D ||
+           (c >= 0x20D0 && c <= 0x20FF) ||
+           (c >= 0xFE00 && c <= 0xFE0F) ||
+           (c >= 0xFE20 && c <= 0xFE2F) ||
+           (c >= 0x1F3FB && c <= 0x1F3FF) ||
+           (c >= 0xE0020 && c <= 0xE007F) ||
+           (c >= 0xE0100 && c <= 0xE01EF);
+}
+
+CharClass Classify(unsigned c) {
+    if (c < 0x80) {
+        if (c == ' ' || (c >= '\t' && c <= '\r')) return CHAR_SPACE;
+        if (c == '_' || (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) return CHAR_WORD;
+        return CHAR_OTHER;
+    }
+    if (c > (unsigned)WCHAR_MAX) return CHAR_OTHER;
+    if (std::iswspace((wint_t)c)) return CHAR_SPACE;
+    return std::iswalnum((wint_t)c) ? CHAR_WORD : CHAR_OTHER;
+}
+
+}
+
+void TextBoundaryIndex::Build(const TextBuffer& text, WordBoundaryMode mode, const std::vector<Span>& spans) {
+    m_length = text.GetLength();
+    m_clusterInterior.clear();
+    m_wordStarts.clear();
+    m_spaces.clear();
+    
+    auto span = spans.begin();
+    CharClass previousClass = CHAR_SPACE;
+    unsigned previous = 0;
+    size_t regionalRun = 0;
+    
+    size_t pos = 0;
+    while (pos < m_length) {
+        // Decode one code point; wchar_t is UTF-16 on some platforms
+        size_t width = 1;
+        unsigned c = (unsigned)text[pos];
+        if (IsHighSurrogate(c) && pos + 1 < m_length && IsLowSurrogate((unsigned)text[pos + 1])) {
+            c = 0x10000 + ((c - 0xD800) << 10) + ((unsigned)text[pos + 1] - 0xDC00);
+            width = 2;
+            m_clusterInterior.push_back(pos + 1);
+        }
+        
+        bool joins = pos > 0 &&
+            (IsExtender(c) ||
+             previous == 0x200D ||
+             (previous == '\r' && c == '\n') ||
+             (IsRegionalIndicator(c) && regionalRun % 2 == 1));
+        regionalRun = IsRegionalIndicator(c) ? regionalRun + 1 : 0;
+        previous = c;
+        
+        if (joins) {
+            for (size_t i = 0; i < width; i++) {
+                m_clusterInterior.push_back(pos + i);
+            }
+            pos += width;
+            continue;
+        }
+        
+        // A cluster takes the class of its first code point
+        CharClass charClass = Classify(c);
+        if (c == ' ') {
+            m_spaces.push_back(pos);
+        }
+        
+        bool wordStart;
+        if (mode == WORD_BOUNDARY_WHITESPACE) {
+            wordStart = charClass != CHAR_SPACE && previousClass == CHAR_SPACE;
+        } else {
+            wordStart = charClass != CHAR_SPACE && charClass != previousClass;
+        }
+        
+        if (mode == WORD_BOUNDARY_TOKENS) {
+            while (span != spans.end() && span->start + span->length <= pos) {
+                ++span;
+            }
+            if (span != spans.end() && span->start <= pos) {
+                wordStart = span->start == pos;
+            } else if (pos > 0 && span != spans.begin() && (span - 1)->start + (span - 1)->length == pos) {
+                // The first character after a token starts a new word
+                wordStart = charClass != CHAR_SPACE;
+            }
+        }
+        
+        if (wordStart) {
+            m_wordStarts.push_back(pos);
+        }
+        previousClass = charClass;
+        pos += width;
+    }
+    
+    // Surrogate halves and extenders may have been pushed out of order
+    std::sort(m_clusterInterior.begin(), m_clusterInterior.end());
+    m_clusterInterior.erase(std::unique(m_clusterInterior.begin(), m_clusterInterior.end()), m_clusterInterior.end());
+    
+    m_valid = true;
+}
+
+bool TextBoundaryIndex::IsCaretStop(size_t pos) const {
+    return !std::binary_search(m_clusterInterior.begin(), m_clusterInterior.end(), pos);
+}
+
+size_t TextBoundaryIndex::GetGraphemeStart(size_t pos) const {
+    pos = std::min(pos, m_length);
+    while (pos > 0 && !IsCaretStop(pos)) {
+        pos--;
+    }
+    return pos;
+}
+
+size_t TextBoundaryIndex::GetNextGrapheme(size_t pos) const {
+    if (pos >= m_length) return m_length;
+    pos++;
+    while (pos < m_length && !IsCaretStop(pos)) {
+        pos++;
+    }
+    return pos;
+}
+
+size_t TextBoundaryIndex::GetPreviousGrapheme(size_t pos) const {
+    if (pos == 0) return 0;
+    return GetGraphemeStart(std::min(pos, m_length + 1) - 1);
+}
+
+size_t TextBoundaryIndex::GetNextWordStart(size_t pos) const {
+    auto it = std::upper_bound(m_wordStarts.begin(), m_wordStarts.end(), pos);
+    return it == m_wordStarts.end() ? m_length : *it;
+}
+
+size_t TextBoundaryIndex::GetPreviousWordStart(size_t pos) const {
+    auto it = std::lower_bound(m_wordStarts.begin(), m_wordStarts.end(), pos);
+    return it == m_wordStarts.begin() ? 0 : *(it - 1);
+}
+
+size_t TextBoundaryIndex::GetCompletionWordStart(size_t pos) const {
+    auto it = std::lower_bound(m_spaces.begin(), m_spaces.end(), pos);
+    return it == m_spaces.begin() ? 0 : *(it - 1) + 1;
+}
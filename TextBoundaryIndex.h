@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TEXT_BOUNDARY_INDEX_H
+#define TEXT_BOUNDARY_INDEX_H
+
+#include "TextBuffer.h"
+#include <vector>
+#include <cstddef>
+
+/**
+ * What counts as a word for word-wise caret movement and deletion
+ */
+enum WordBoundaryMode {
+    WORD_BOUNDARY_WHITESPACE,   ///< Words are runs of non-whitespace
+    WORD_BOUNDARY_PUNCTUATION,  ///< Runs of letters, digits and '_' are split from runs of other symbols
+    WORD_BOUNDARY_TOKENS        ///< As WORD_BOUNDARY_PUNCTUATION, but every highlighted token is one word
+};
+
+/**
+ * Caret stops and word starts of one revision of a text
+ *
+ * Built once per revision in a single pass, then answers navigation queries with a
+ * binary search. Caret stops are grapheme cluster boundaries, so surrogate pairs,
+ * combining marks, emoji sequences and CR LF are never split; the clustering follows
+ * the common cases of Unicode's extended grapheme clusters rather than the full rules.
+ */
+class TextBoundaryIndex {
+public:
+    /**
+     * A range [start, start + length) that forms one word, e.g. a highlighted token
+     */
+    struct Span {
+        size_t start;
+        size_t length;
+    };
+    
+    TextBoundaryIndex() : m_valid(false), m_length(0) {}
+    
+    /**
+     * @param spans Ranges that must not be split, sorted; only used with WORD_BOUNDARY_TOKENS
+     */
+    void Build(const TextBuffer& text, WordBoundaryMode mode, const std::vector<Span>& spans);
+    void Invalidate() { m_valid = false; }
+    bool IsValid() const { return m_valid; }
+    
+    /** @return The caret stop at or before @p pos */
+    size_t GetGraphemeStart(size_t pos) const;
+    /** @return The first caret stop after @p pos, or the text length */
+    size_t GetNextGrapheme(size_t pos) const;
+    /** @return The last caret stop before @p pos, or 0 */
+    size_t GetPreviousGrapheme(size_t pos) const;
+    
+    /** @return The start of the first word after @p pos, or the text length */
+    size_t GetNextWordStart(size_t pos) const;
+    /** @return The start of the last word beginning before @p pos, or 0 */
+    size_t GetPreviousWordStart(size_t pos) const;
+    
+    /** @return The start of the space-delimited word that ends at @p pos, the range completions replace */
+    size_t GetCompletionWordStart(size_t pos) const;
+    
+private:
+    bool m_valid;
+    size_t m_length;
+    std::vector<size_t> m_clusterInterior;  // Positions that are not caret stops; rare, so stored sparsely
+    std::vector<size_t> m_wordStarts;
+    std::vector<size_t> m_spaces;
+    
+    bool IsCaretStop(size_t pos) const;
+};
+
+#endif // TEXT_BOUNDARY_INDEX_H
@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TextBuffer.h"
+#include <algorithm>
+#include <string>
+
+// Free space kept after growing, so a run of typing reallocates rarely
+static const size_t MIN_GAP = 64;
+
+TextBuffer::TextBuffer(const wxString& text)
+    : m_gapStart(0),
+      m_gapEnd(0) {
+    Replace(0, 0, text);
+}
+
+void TextBuffer::Replace(size_t pos, size_t length, const wxString& text) {
+    std::wstring inserted = text.ToStdWstring();
+    
+    MoveGap(pos);
+    m_gapEnd += length;
+    
+    if (inserted.length() > m_gapEnd - m_gapStart) {
+        // Grow geometrically and put all the new space into the gap
+        size_t tail = m_data.size() - m_gapEnd;
+        size_t size = std::max(m_data.size() * 2, m_gapStart + inserted.length() + tail + MIN_GAP);
+        std::vector<wchar_t> data(size);
+        std::copy(m_data.begin(), m_data.begin() + m_gapStart, data.begin());
+        std::copy(m_data.end() - tail, m_data.end(), data.end() - tail);
+        m_data.swap(data);
+        m_gapEnd = m_data.size() - tail;
+    }
+    
+    std::copy(inserted.begin(), inserted.end(), m_data.begin() + m_gapStart);
+    m_gapStart += inserted.length();
+}
+
+wxString TextBuffer::Mid(size_t pos, size_t length) const {
+    size_t end = std::min(GetLength(), pos + std::min(length, GetLength()));
+    if (pos >= end) {
+        return wxString();
+    }
+    
+    std::wstring text;
+    text.reserve(end - pos);
+    if (pos < m_gapStart) {
+        text.append(&m_data[pos], std::min(end, m_gapStart) - pos);
+    }
+    if (end > m_gapStart) {
+        size_t from = std::max(pos, m_gapStart);
+        size_t gap = m_gapEnd - m_gapStart;
+        text.append(&m_data[from + gap], end - from);
+    }
+    return wxString(text);
+}
+
+const wchar_t* TextBuffer::GetView(size_t from, size_t to) {
+    static const wchar_t empty = 0;
+    if (from >= to) {
+        return &empty;
+    }
+    
+    if (from < m_gapStart && to > m_gapStart) {
+        MoveGap(m_gapStart - from < to - m_gapStart ? from : to);
+    }
+    return &m_data[from < m_gapStart ? from : from + (m_gapEnd - m_gapStart)];
+}
+
+void TextBuffer::MoveGap(size_t pos) {
+    if (pos < m_gapStart) {
+        std::copy_backward(m_data.begin() + pos, m_data.begin() + m_gapStart, m_data.begin() + m_gapEnd);
+        m_gapEnd -= m_gapStart - pos;
+        m_gapStart = pos;
+    } else if (pos > m_gapStart) {
+        size_t count = pos - m_gapStart;
+        std::copy(m_data.begin() + m_gapEnd, m_data.begin() + m_gapEnd + count, m_data.begin() + m_gapStart);
+        m_gapStart = pos;
+        m_gapEnd += count;
+    }
+}
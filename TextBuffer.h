@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include <wx/string.h>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Gap buffer of UTF-16 or UTF-32 code units, whichever wchar_t holds
+ *
+ * The free space sits where the last edit happened, so typing and deleting at the
+ * caret only touch the characters edited, and moving the gap costs the distance it
+ * travels. Characters are indexed in constant time in every wxWidgets build, which
+ * is not true of a UTF-8 wxString.
+ */
+class TextBuffer {
+public:
+    TextBuffer() : m_gapStart(0), m_gapEnd(0) {}
+    explicit TextBuffer(const wxString& text);
+    
+    size_t GetLength() const { return m_data.size() - (m_gapEnd - m_gapStart); }
+    
+    wchar_t operator[](size_t pos) const {
+        return m_data[pos < m_gapStart ? pos : pos + (m_gapEnd - m_gapStart)];
+    }
+    
+    /** Replaces the @p length characters at @p pos with @p text */
+    void Replace(size_t pos, size_t length, const wxString& text);
+    
+    wxString Mid(size_t pos, size_t length) const;
+    wxString ToString() const { return Mid(0, GetLength()); }
+    
+    /**
+     * Makes [from, to) contiguous by moving the gap to whichever end of it is nearer
+     * @return A pointer to the character at @p from, valid until the buffer is next changed
+     */
+    const wchar_t* GetView(size_t from, size_t to);
+    
+private:
+    std::vector<wchar_t> m_data;
+    size_t m_gapStart;
+    size_t m_gapEnd;
+    
+    void MoveGap(size_t pos);
+};
+
+#endif // TEXT_BUFFER_H
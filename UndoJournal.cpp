@@ -0,0 +1,141 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "UndoJournal.h"
+
+void UndoJournal::SetBudget(size_t bytes) {
+    m_budget = bytes;
+    Trim();
+}
+
+void UndoJournal::BeginStep(EditKind kind, size_t cursorPos) {
+    m_kind = kind;
+    m_cursorBefore = cursorPos;
+    m_stepOpen = false;
+}
+
+void UndoJournal::Record(size_t pos, const wxString& removed, const wxString& inserted) {
+    if (removed.IsEmpty() && inserted.IsEmpty()) return;
+    
+    if (!m_stepOpen) {
+        ClearRedo();
+        
+        bool coalesced = m_canCoalesce && m_kind != EDIT_OTHER && !m_undo.empty() &&
+                         m_undo.back().kind == m_kind && Merge(m_undo.back(), pos, removed, inserted);
+        if (!coalesced) {
+            m_undo.push_back({{{pos, removed, inserted}}, m_cursorBefore, m_kind, 0});
+        }
+        m_stepOpen = true;
+    } else if (!Merge(m_undo.back(), pos, removed, inserted)) {
+        m_undo.back().deltas.push_back({pos, removed, inserted});
+    }
+    
+    m_canCoalesce = m_kind != EDIT_OTHER;
+    UpdateBytes(m_undo.back());
+    Trim();
+}
+
+bool UndoJournal::Merge(Step& step, size_t pos, const wxString& removed, const wxString& inserted) {
+    Delta& last = step.deltas.back();
+    
+    // Typing on at the end of the previous insertion
+    if (removed.IsEmpty() && pos == last.pos + last.inserted.length()) {
+        last.inserted += inserted;
+        return true;
+    }
+    
+    if (!inserted.IsEmpty() || !last.inserted.IsEmpty()) return false;
+    
+    // Backspace just before the previous deletion
+    if (pos + removed.length() == last.pos) {
+        last.removed = removed + last.removed;
+        last.pos = pos;
+        return true;
+    }
+    
+    // Delete at the same position as the previous deletion
+    if (pos == last.pos) {
+        last.removed += removed;
+        return true;
+    }
+    
+    return false;
+}
+
+void UndoJournal::UpdateBytes(Step& step) {
+    size_t bytes = sizeof(Step);
+    for (const auto& delta : step.deltas) {
+        bytes += sizeof(Delta) + (delta.removed.length() + delta.inserted.length()) * sizeof(wxChar);
+    }
+    m_bytes = m_bytes - step.bytes + bytes;
+    step.bytes = bytes;
+}
+
+void UndoJournal::ClearRedo() {
+    for (const auto& step : m_redo) {
+        m_bytes -= step.bytes;
+    }
+    m_redo.clear();
+}
+
+void UndoJournal::Trim() {
+    // Drop the oldest undo steps first, then the redo steps furthest from the present
+    while (m_bytes > m_budget && m_undo.size() + m_redo.size() > 1) {
+        if (m_undo.size() > 1 || (m_undo.size() == 1 && m_redo.empty())) {
+            m_bytes -= m_undo.front().bytes;
+            m_undo.pop_front();
+        } else {
+            m_bytes -= m_redo.front().bytes;
+            m_redo.pop_front();
+        }
+    }
+}
+
+const UndoJournal::Step* UndoJournal::Undo() {
+    if (m_undo.empty()) return nullptr;
+    
+    m_redo.push_back(std::move(m_undo.back()));
+    m_undo.pop_back();
+    m_canCoalesce = false;
+    m_stepOpen = false;
+    return &m_redo.back();
+}
+
+const UndoJournal::Step* UndoJournal::Redo() {
+    if (m_redo.empty()) return nullptr;
+    
+    m_undo.push_back(std::move(m_redo.back()));
+    m_redo.pop_back();
+    m_canCoalesce = false;
+    m_stepOpen = false;
+    return &m_undo.back();
+}
+
+void UndoJournal::Clear() {
+    m_undo.clear();
+    m_redo.clear();
+    m_bytes = 0;
+    m_canCoalesce = false;
+    m_stepOpen = false;
+}
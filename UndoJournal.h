@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef UNDO_JOURNAL_H
+#define UNDO_JOURNAL_H
+
+#include <wx/string.h>
+#include <vector>
+#include <deque>
+
+/**
+ * Undo history stored as insert/delete deltas
+ *
+ * Each undo step is the list of replacements one user action made. Runs of typing or
+ * deleting at adjacent positions are merged into a single step, so a typed word costs
+ * one delta rather than a copy of the text per keystroke. The oldest steps are dropped
+ * once the history exceeds its memory budget; the newest step is always kept.
+ */
+class UndoJournal {
+public:
+    /** Kinds of edit; consecutive edits of the same kind other than EDIT_OTHER coalesce */
+    enum EditKind { EDIT_OTHER, EDIT_TYPING, EDIT_DELETE };
+    
+    /**
+     * Replacement of @p removed by @p inserted at @p pos
+     */
+    struct Delta {
+        size_t pos;
+        wxString removed;
+        wxString inserted;
+    };
+    
+    struct Step {
+        std::vector<Delta> deltas;  // In the order they were applied
+        size_t cursorBefore;
+        EditKind kind;
+        size_t bytes;
+    };
+    
+    static const size_t DEFAULT_BUDGET = 256 * 1024;
+    
+    UndoJournal() : m_budget(DEFAULT_BUDGET), m_bytes(0), m_kind(EDIT_OTHER), m_cursorBefore(0),
+                    m_stepOpen(false), m_canCoalesce(false) {}
+    
+    void SetBudget(size_t bytes);
+    size_t GetBudget() const { return m_budget; }
+    size_t GetMemoryUsage() const { return m_bytes; }
+    
+    /**
+     * Starts a user action; the deltas recorded until the next BeginStep() form one step
+     * @param cursorPos The caret position to restore when the step is undone
+     */
+    void BeginStep(EditKind kind, size_t cursorPos);
+    void Record(size_t pos, const wxString& removed, const wxString& inserted);
+    /** Ends the current run of typing or deleting, e.g. because the caret was moved */
+    void BreakCoalescing() { m_canCoalesce = false; }
+    
+    bool CanUndo() const { return !m_undo.empty(); }
+    bool CanRedo() const { return !m_redo.empty(); }
+    
+    /**
+     * Moves the newest step to the redo history
+     * @return The step to revert, valid until the journal is next modified, or nullptr
+     */
+    const Step* Undo();
+    /** @return The step to apply again, valid until the journal is next modified, or nullptr */
+    const Step* Redo();
+    void Clear();
+    
+private:
+    std::deque<Step> m_undo;
+    std::deque<Step> m_redo;
+    size_t m_budget;
+    size_t m_bytes;  // Held by both histories
+    
+    EditKind m_kind;
+    size_t m_cursorBefore;
+    bool m_stepOpen;     // A delta has been recorded since BeginStep()
+    bool m_canCoalesce;  // The newest step may absorb the next edit
+    
+    static bool Merge(Step& step, size_t pos, const wxString& removed, const wxString& inserted);
+    void UpdateBytes(Step& step);
+    void ClearRedo();
+    void Trim();
+};
+
+#endif // UNDO_JOURNAL_H
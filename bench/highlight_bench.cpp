@@ -0,0 +1,120 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <wx/init.h>
+#include "SyntaxHighlighter.h"
+#include <chrono>
+#include <cstdio>
+
+// Compares full highlighting passes of the per-rule engine against the combined
+// lexer, using the grammar from the demo application
+
+static void AddDemoRules(SyntaxHighlighter& highlighter) {
+    highlighter.AddRule("\\b(let|if|then|else|print|return|function)\\b",
+                        highlighter.AddStyle(TextStyle(wxColour(0, 0, 255), true)));
+    highlighter.AddRule("\\b\\d+(\\.\\d+)?\\b", highlighter.AddStyle(TextStyle(wxColour(0, 128, 0))));
+    highlighter.AddRule("[+\\-*/=<>!]+", highlighter.AddStyle(TextStyle(wxColour(255, 0, 0))));
+    highlighter.AddRule("\"[^\"]*\"", highlighter.AddStyle(TextStyle(wxColour(128, 0, 128))));
+    highlighter.AddRule("//.*", highlighter.AddStyle(TextStyle(wxColour(128, 128, 128), false, true)));
+}
+
+static wxString MakeText(size_t length) {
+    static const char* samples[] = {
+        "let counter = 42 + 3.14",
+        "if x >= 10 then print \"large\"",
+        "function add(a, b) return a + b",
+        "else return counter * 2 != total",
+    };
+
+    wxString text;
+    for (size_t i = 0; text.length() < length; i++) {
+        text += samples[i % 4];
+        text += " ";
+    }
+    return text.Mid(0, length) + " // trailing comment";
+}
+
+// Milliseconds per full highlighting pass
+static double TimeHighlight(SyntaxHighlighter& highlighter, const wxString& text) {
+    int iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> elapsed(0);
+
+    while (iterations < 5 || elapsed.count() < 200) {
+        highlighter.Invalidate();
+        highlighter.Update(text);
+        iterations++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    return elapsed.count() / iterations;
+}
+
+static bool SameTokens(const std::vector<StyledSegment>& a, const std::vector<StyledSegment>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].start != b[i].start || a[i].length != b[i].length) return false;
+    }
+    return true;
+}
+
+int main() {
+    wxInitializer initializer;
+    if (!initializer.IsOk()) {
+        fprintf(stderr, "Failed to initialize wxWidgets\n");
+        return 1;
+    }
+
+    // Time the lexing itself rather than lookups in the shared result cache, and let
+    // every rule finish so that both engines produce complete results to compare
+    SyntaxHighlighter regex;
+    AddDemoRules(regex);
+    regex.SetResultCaching(false);
+    regex.SetMatchBudget(0);
+
+    SyntaxHighlighter combined;
+    AddDemoRules(combined);
+    combined.SetEngine(SYNTAX_ENGINE_COMBINED);
+    combined.SetResultCaching(false);
+    combined.SetMatchBudget(0);
+
+    printf("%10s %14s %14s %10s\n", "chars", "per-rule ms", "combined ms", "speedup");
+
+    const size_t lengths[] = {64, 512, 2048, 8192, 65536};
+    for (size_t length : lengths) {
+        wxString text = MakeText(length);
+
+        double regexTime = TimeHighlight(regex, text);
+        double combinedTime = TimeHighlight(combined, text);
+
+        if (!SameTokens(regex.Update(text), combined.Update(text))) {
+            fprintf(stderr, "Engines disagree on %zu characters\n", text.length());
+            return 1;
+        }
+
+        printf("%10zu %14.3f %14.3f %9.1fx\n", text.length(), regexTime, combinedTime,
+               regexTime / combinedTime);
+    }
+
+    return 0;
+}
@@ -24,6 +24,7 @@
 
 #include <wx/wx.h>
 #include "SyntaxTextCtrl.h"
+#include "CompletionMatcher.h"
 
 // Demo application showcasing a custom mini-language
 // The mini-language has:
@@ -42,6 +43,7 @@ private:
     SyntaxTextCtrl* m_textCtrl2;
     SyntaxTextCtrl* m_textCtrl3;
     wxTextCtrl* m_output;
+    SyntaxGrammarPtr m_grammar;  // Compiled once, shared by all three controls
     
     void SetupSyntaxHighlighting(SyntaxTextCtrl* ctrl);
     void SetupCompletions(SyntaxTextCtrl* ctrl);
@@ -162,77 +164,48 @@ MyFrame::MyFrame()
 }
 
 void MyFrame::SetupSyntaxHighlighting(SyntaxTextCtrl* ctrl) {
+    if (m_grammar) {
+        ctrl->SetSyntaxGrammar(m_grammar);
+        return;
+    }
+    
+    SyntaxGrammar grammar;
+    StyleId keyword = grammar.AddStyle(TextStyle(wxColour(0, 0, 255), true));          // Bold blue
+    StyleId number = grammar.AddStyle(TextStyle(wxColour(0, 128, 0)));                 // Green
+    StyleId op = grammar.AddStyle(TextStyle(wxColour(255, 0, 0)));                     // Red
+    StyleId quoted = grammar.AddStyle(TextStyle(wxColour(128, 0, 128)));               // Purple
+    StyleId comment = grammar.AddStyle(TextStyle(wxColour(128, 128, 128), false, true));   // Gray italic
+    
     // Keywords: let, if, then, else, print, return, function
-    ctrl->AddSyntaxRule(
-        "\\b(let|if|then|else|print|return|function)\\b",
-        [](const wxString& WXUNUSED(text)) {
-            return wxColour(0, 0, 255); // Blue
-        }
-    );
+    grammar.AddRule("\\b(let|if|then|else|print|return|function)\\b", keyword);
     
     // Numbers (integers and floats)
-    ctrl->AddSyntaxRule(
-        "\\b\\d+(\\.\\d+)?\\b",
-        [](const wxString& WXUNUSED(text)) {
-            return wxColour(0, 128, 0); // Green
-        }
-    );
+    grammar.AddRule("\\b\\d+(\\.\\d+)?\\b", number);
     
     // Operators
-    ctrl->AddSyntaxRule(
-        "[+\\-*/=<>!]+",
-        [](const wxString& WXUNUSED(text)) {
-            return wxColour(255, 0, 0); // Red
-        }
-    );
+    grammar.AddRule("[+\\-*/=<>!]+", op);
     
     // Strings (text in quotes)
-    ctrl->AddSyntaxRule(
-        "\"[^\"]*\"",
-        [](const wxString& WXUNUSED(text)) {
-            return wxColour(128, 0, 128); // Purple
-        }
-    );
+    grammar.AddRule("\"[^\"]*\"", quoted);
     
     // Comments (// to end of line)
-    ctrl->AddSyntaxRule(
-        "//.*",
-        [](const wxString& WXUNUSED(text)) {
-            return wxColour(128, 128, 128); // Gray
-        }
-    );
+    grammar.AddRule("//.*", comment);
+    
+    m_grammar = grammar.Compile();
+    ctrl->SetSyntaxGrammar(m_grammar);
 }
 
 void MyFrame::SetupCompletions(SyntaxTextCtrl* ctrl) {
-    ctrl->SetCompletionFunction([](const wxString& textToCursor) -> std::vector<wxString> {
-        std::vector<wxString> allCompletions = {
-            "let", "if", "then", "else", "print", "return", "function",
-            "true", "false", "null",
-            "add", "subtract", "multiply", "divide",
-            "length", "concat", "split"
-        };
-        
-        // Find the current word being typed (after last space)
-        wxString currentWord;
-        int lastSpace = textToCursor.Find(' ', true);
-        if (lastSpace == wxNOT_FOUND) {
-            currentWord = textToCursor;
-        } else {
-            currentWord = textToCursor.Mid(lastSpace + 1);
-        }
-        
-        // Filter completions that start with current word
-        std::vector<wxString> matches;
-        if (!currentWord.IsEmpty()) {
-            for (const auto& comp : allCompletions) {
-                if (comp.Lower().StartsWith(currentWord.Lower())) {
-                    matches.push_back(comp);
-                }
-            }
-        }
-        
-        return matches;
+    CompletionMatcher matcher;
+    matcher.SetCandidates({
+        "let", "if", "then", "else", "print", "return", "function",
+        "true", "false", "null",
+        "add", "subtract", "multiply", "divide",
+        "length", "concat", "split"
     });
+    
+    // Matches the word before the cursor by prefix, then by subsequence ("fn" -> "function")
+    ctrl->SetCompletionFunction(matcher.GetCompletionFunction());
 }
 
 void MyFrame::OnIncreaseFontSize(wxCommandEvent& WXUNUSED(event)) {
@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "check.h"
+#include "CompletionProvider.h"
+
+// Exact hits and narrowing of cached completion results while typing a word
+
+static std::vector<wxString> Words(std::initializer_list<const char*> words) {
+    std::vector<wxString> result;
+    for (const char* word : words) {
+        result.push_back(word);
+    }
+    return result;
+}
+
+static void TestExactHit() {
+    CompletionCache cache;
+    std::vector<wxString> completions;
+    CHECK(!cache.Find("let x = pr", completions));
+    
+    cache.Store("let x = pr", Words({"print", "println"}));
+    CHECK(cache.Find("let x = pr", completions));
+    CHECK(completions == Words({"print", "println"}));
+    
+    // Without prefix filtering a longer text is a miss
+    CHECK(!cache.Find("let x = pri", completions));
+    
+    cache.Clear();
+    CHECK(!cache.Find("let x = pr", completions));
+}
+
+static void TestNarrowing() {
+    CompletionCache cache;
+    cache.SetPrefixFilterable(true);
+    cache.Store("let x = p", Words({"print", "println", "parse", "pow"}));
+    
+    std::vector<wxString> completions;
+    CHECK(cache.Find("let x = pri", completions));
+    CHECK(completions == Words({"print", "println"}));
+    
+    // Narrowed results are cached too, and the longest cached prefix is used
+    CHECK(cache.Find("let x = prin", completions));
+    CHECK(completions == Words({"print", "println"}));
+    CHECK(cache.Find("let x = printl", completions));
+    CHECK(completions == Words({"println"}));
+    CHECK(cache.Find("let x = pz", completions));
+    CHECK(completions.empty());
+    
+    // A new word, or a different text, has to go to the provider
+    CHECK(!cache.Find("let x = p q", completions));
+    CHECK(!cache.Find("let y = pri", completions));
+    CHECK(!cache.Find("let x = ", completions));
+}
+
+static void TestEviction() {
+    CompletionCache cache;
+    for (int i = 0; i < 100; i++) {
+        cache.Store(wxString::Format("text %d", i), Words({"a"}));
+    }
+    
+    std::vector<wxString> completions;
+    CHECK(cache.Find("text 99", completions));
+    CHECK(!cache.Find("text 0", completions));
+}
+
+int main() {
+    TestExactHit();
+    TestNarrowing();
+    TestEviction();
+    return CHECK_RESULT();
+}
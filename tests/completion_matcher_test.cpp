@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "check.h"
+#include "CompletionMatcher.h"
+#include <string>
+#include <thread>
+
+// Ranking of fuzzy matches, and merging of the slices a large corpus is split into
+
+static std::vector<wxString> Words(std::initializer_list<const char*> words) {
+    std::vector<wxString> result;
+    for (const char* word : words) {
+        result.push_back(word);
+    }
+    return result;
+}
+
+// c0 to c99999, large enough to be scanned in slices
+static CompletionMatcher LargeMatcher() {
+    std::vector<wxString> candidates;
+    for (int i = 0; i < 100000; i++) {
+        candidates.push_back(wxString(L"c" + std::to_wstring(i)));
+    }
+    CompletionMatcher matcher;
+    matcher.SetCandidates(candidates);
+    return matcher;
+}
+
+static void TestRanking() {
+    CompletionMatcher matcher;
+    matcher.SetCandidates(Words({"sprint", "printLine", "print", "p_r_i", "PrInt", "print", "other"}));
+    CHECK(matcher.GetCandidateCount() == 6);  // The second "print" is dropped
+    
+    // Prefixes first, shorter ones first, then in registration order; then subsequences,
+    // where starting words beats running on
+    CHECK(matcher.Match("pri", 10) == Words({"print", "PrInt", "printLine", "p_r_i", "sprint"}));
+    CHECK(matcher.Match("pri", 2) == Words({"print", "PrInt"}));
+    CHECK(matcher.Match("xyz", 10).empty());
+    CHECK(matcher.Match("", 10).empty());
+    
+    // The completion function matches the word before the cursor
+    CHECK(matcher.GetCompletionFunction(1)("let x = spr") == Words({"sprint"}));
+}
+
+static void TestSlices() {
+    CompletionMatcher matcher = LargeMatcher();
+    
+    // c9999 lies in an early slice and ranks ahead of the longer c99990 to c99999 at the
+    // end; subsequence matches such as c19999 come after these prefixes
+    std::vector<wxString> expected = Words({"c9999", "c99990", "c99991", "c99992", "c99993", "c99994",
+                                            "c99995", "c99996", "c99997", "c99998", "c99999"});
+    CHECK(matcher.Match("c9999", 11) == expected);
+    CHECK(matcher.Match("C9999", 3) == Words({"c9999", "c99990", "c99991"}));
+    
+    // Queries from several threads at once share the pool or scan on their own
+    std::vector<std::thread> threads;
+    std::vector<std::vector<wxString>> results(4);
+    for (size_t t = 0; t < results.size(); t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 20; i++) {
+                results[t] = matcher.Match("c9999", 11);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& result : results) {
+        CHECK(result == expected);
+    }
+}
+
+static void TestCancellation() {
+    CompletionMatcher matcher = LargeMatcher();
+    AsyncCompletionFunc complete = matcher.GetAsyncCompletionFunction(11);
+    std::atomic<unsigned long> latest(1);
+    
+    CompletionRequest current(&latest, 1);
+    CHECK(complete("c9999", current).size() == 11);
+    
+    // A superseded request stops before scanning anything
+    CompletionRequest superseded(&latest, 0);
+    CHECK(complete("c9999", superseded).empty());
+    
+    // The function keeps the corpus it was created with
+    matcher.SetCandidates(Words({"c9999"}));
+    CHECK(complete("c9999", current).size() == 11);
+    CHECK(matcher.Match("c9999", 11).size() == 1);
+}
+
+int main() {
+    TestRanking();
+    TestSlices();
+    TestCancellation();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,207 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "check.h"
+#include "SyntaxHighlighter.h"
+#include <wx/init.h>
+#include <iterator>
+
+// Incremental re-highlighting must give the same runs as highlighting from scratch
+
+static void AddRules(SyntaxHighlighter& highlighter) {
+    highlighter.AddRule("\\b(let|if|then|else|return)\\b", highlighter.AddStyle(TextStyle(wxColour(0, 0, 255))));
+    highlighter.AddRule("\\b\\d+\\b", highlighter.AddStyle(TextStyle(wxColour(0, 128, 0))));
+    highlighter.AddRule("\"[^\"]*\"", highlighter.AddStyle(TextStyle(wxColour(128, 0, 128))));
+}
+
+static bool SameTokens(const std::vector<StyledSegment>& a, const std::vector<StyledSegment>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].start != b[i].start || a[i].length != b[i].length || a[i].style != b[i].style) return false;
+    }
+    return true;
+}
+
+static wxString MakeText(size_t length) {
+    wxString text;
+    for (size_t i = 0; text.length() < length; i++) {
+        text += i % 3 == 0 ? "let x = 42 " : i % 3 == 1 ? "if \"a b\" then 7 " : "else return 1000 ";
+    }
+    return text;
+}
+
+// Applies an edit to @p buffer and @p highlighter, then compares against a fresh pass
+static void CheckEdit(SyntaxHighlighter& highlighter, TextBuffer& buffer,
+                      size_t pos, size_t removed, const wxString& inserted) {
+    buffer.Replace(pos, removed, inserted);
+    highlighter.NoteEdit(pos, removed, inserted.length());
+    const std::vector<StyledSegment> incremental = highlighter.Update(buffer);
+    
+    SyntaxHighlighter fresh;
+    AddRules(fresh);
+    CHECK(SameTokens(incremental, fresh.Update(buffer.ToString())));
+}
+
+static void TestIncrementalEdits(SyntaxEngine engine) {
+    SyntaxHighlighter highlighter;
+    AddRules(highlighter);
+    highlighter.SetEngine(engine);
+    highlighter.SetMatchBudget(0);
+    
+    TextBuffer buffer(MakeText(8192));
+    highlighter.Update(buffer);
+    CHECK(highlighter.IsUpToDate());
+    
+    // Typing inside a token, deleting across tokens and replacing a keyword
+    CheckEdit(highlighter, buffer, 4000, 0, "9");
+    CheckEdit(highlighter, buffer, 100, 12, "");
+    CheckEdit(highlighter, buffer, 2000, 3, "return");
+    
+    // Several edits before one update
+    buffer.Replace(10, 0, "1 ");
+    highlighter.NoteEdit(10, 0, 2);
+    buffer.Replace(7000, 5, "");
+    highlighter.NoteEdit(7000, 5, 0);
+    CheckEdit(highlighter, buffer, 500, 0, "let ");
+    
+    // A new quote re-pairs every string after it, far beyond the first window
+    CheckEdit(highlighter, buffer, 50, 0, "\"");
+    CheckEdit(highlighter, buffer, 50, 1, "");
+    
+    // Edits at both ends of the text
+    CheckEdit(highlighter, buffer, 0, 0, "return ");
+    CheckEdit(highlighter, buffer, buffer.GetLength(), 0, " 12");
+    CheckEdit(highlighter, buffer, 0, buffer.GetLength(), "let 1");
+}
+
+// Over budget, a rule is skipped for 1, 2, 4 ... 64 updates while it keeps failing
+static void TestBudgetBackoff() {
+    SyntaxHighlighter highlighter;
+    highlighter.AddRule("[a-z]", highlighter.AddStyle(TextStyle(wxColour(0, 0, 255))));
+    highlighter.SetResultCaching(false);
+    highlighter.SetMatchBudget(1);
+    
+    std::vector<int> failed;
+    int update = 0;
+    highlighter.SetBudgetExceededFunction([&](const SyntaxRule&, const wxString&) {
+        failed.push_back(update);
+    });
+    
+    // One match per character takes far longer than a millisecond
+    wxString text(std::wstring(100000, L'x'));
+    for (update = 1; update <= 140; update++) {
+        highlighter.Invalidate();
+        highlighter.Update(text);
+    }
+    
+    const int expected[] = {1, 3, 6, 11, 20, 37, 70, 135};
+    CHECK(failed == std::vector<int>(std::begin(expected), std::end(expected)));
+}
+
+// A rule that finishes within its budget again starts over with the shortest penalty
+static void TestBudgetRecovery() {
+    SyntaxHighlighter highlighter;
+    highlighter.AddRule("[a-z]", highlighter.AddStyle(TextStyle(wxColour(0, 0, 255))));
+    highlighter.SetResultCaching(false);
+    highlighter.SetMatchBudget(1);
+    
+    int failures = 0;
+    highlighter.SetBudgetExceededFunction([&](const SyntaxRule&, const wxString&) { failures++; });
+    
+    wxString slow(std::wstring(100000, L'x'));
+    CHECK(highlighter.Update(slow).empty());
+    CHECK(failures == 1);
+    
+    // Skipped for one update, then back
+    highlighter.Invalidate();
+    CHECK(highlighter.Update(wxString("abc")).empty());
+    highlighter.Invalidate();
+    CHECK(highlighter.Update(wxString("abc")).size() == 3);
+    
+    highlighter.Invalidate();
+    highlighter.Update(slow);
+    CHECK(failures == 2);
+    highlighter.Invalidate();
+    highlighter.Update(slow);
+    CHECK(failures == 2);
+    highlighter.Invalidate();
+    highlighter.Update(slow);
+    CHECK(failures == 3);
+    
+    // Changing the budget lifts the suspension
+    highlighter.SetMatchBudget(0);
+    highlighter.Invalidate();
+    CHECK(highlighter.Update(wxString("abc")).size() == 3);
+}
+
+// A search that finds nothing is cut short as well, with either engine
+static void TestSearchBudget(SyntaxEngine engine) {
+    SyntaxHighlighter highlighter;
+    highlighter.AddRule("<[^>]*>", highlighter.AddStyle(TextStyle(wxColour(0, 0, 255))));
+    highlighter.SetEngine(engine);
+    highlighter.SetResultCaching(false);
+    highlighter.SetMatchBudget(1);
+    
+    int failures = 0;
+    highlighter.SetBudgetExceededFunction([&](const SyntaxRule&, const wxString&) { failures++; });
+    
+    // Every < opens a tag that is never closed
+    CHECK(highlighter.Update(wxString(std::wstring(1 << 20, L'<'))).empty());
+    CHECK(failures == 1);
+    
+    highlighter.SetMatchBudget(0);
+    highlighter.Invalidate();
+    const std::vector<StyledSegment>& tokens = highlighter.Update(wxString("a <b> c"));
+    CHECK(tokens.size() == 1 && tokens[0].start == 2 && tokens[0].length == 3);
+}
+
+// Backtrack-prone rules give the same matches as std::regex would
+static void TestNestedQuantifiers() {
+    SyntaxHighlighter highlighter;
+    highlighter.AddRule("(a+)+b", highlighter.AddStyle(TextStyle(wxColour(0, 0, 255))));
+    highlighter.SetResultCaching(false);
+    
+    CHECK(highlighter.Update(wxString(std::wstring(20000, L'a'))).empty());
+    highlighter.Invalidate();
+    const std::vector<StyledSegment>& tokens = highlighter.Update(wxString("xaaab"));
+    CHECK(tokens.size() == 1 && tokens[0].start == 1 && tokens[0].length == 4);
+}
+
+int main() {
+    wxInitializer initializer;
+    if (!initializer.IsOk()) {
+        fprintf(stderr, "Failed to initialize wxWidgets\n");
+        return 1;
+    }
+    
+    TestIncrementalEdits(SYNTAX_ENGINE_REGEX);
+    TestIncrementalEdits(SYNTAX_ENGINE_COMBINED);
+    TestBudgetBackoff();
+    TestBudgetRecovery();
+    TestSearchBudget(SYNTAX_ENGINE_REGEX);
+    TestSearchBudget(SYNTAX_ENGINE_COMBINED);
+    TestNestedQuantifiers();
+    return CHECK_RESULT();
+}
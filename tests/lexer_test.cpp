@@ -0,0 +1,158 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "check.h"
+#include "SyntaxLexer.h"
+#include <regex>
+#include <algorithm>
+
+// The combined automaton must claim the same runs as one std::regex search per rule
+// with earlier rules winning overlaps
+
+static const wchar_t* PATTERNS[] = {
+    L"\\b(let|if|then|else|print|return|function)\\b",
+    L"\\b\\d+(\\.\\d+)?\\b",
+    L"[+\\-*/=<>!]+",
+    L"\"[^\"]*\"",
+    L"//.*",
+    L"\\b[A-Z]\\w*",
+    L"<[^>]*>",
+};
+
+static std::vector<SyntaxToken> ScanWithRegex(const std::wstring& text, size_t from) {
+    std::vector<bool> claimed(text.length(), false);
+    std::vector<SyntaxToken> tokens;
+    
+    for (size_t rule = 0; rule < sizeof(PATTERNS) / sizeof(PATTERNS[0]); rule++) {
+        std::wregex pattern(PATTERNS[rule]);
+        std::wsregex_iterator it(text.begin() + from, text.end(), pattern,
+                                 from > 0 ? std::regex_constants::match_prev_avail
+                                          : std::regex_constants::match_default);
+        for (; it != std::wsregex_iterator(); ++it) {
+            size_t start = from + it->position();
+            size_t length = it->length();
+            bool free = true;
+            for (size_t i = start; i < start + length; i++) {
+                free = free && !claimed[i];
+            }
+            if (!free) continue;
+            std::fill(claimed.begin() + start, claimed.begin() + start + length, true);
+            tokens.push_back({start, length, rule});
+        }
+    }
+    
+    std::sort(tokens.begin(), tokens.end(),
+              [](const SyntaxToken& a, const SyntaxToken& b) { return a.start < b.start; });
+    return tokens;
+}
+
+static bool SameTokens(const std::vector<SyntaxToken>& a, const std::vector<SyntaxToken>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].start != b[i].start || a[i].length != b[i].length || a[i].rule != b[i].rule) return false;
+    }
+    return true;
+}
+
+static void TestMatchesRegex() {
+    SyntaxLexer lexer;
+    CHECK(lexer.Compile(std::vector<std::wstring>(std::begin(PATTERNS), std::end(PATTERNS))));
+    
+    const wchar_t* texts[] = {
+        L"",
+        L"let x = 42",
+        L"if x >= 10 then print \"large\" else return 3.14",
+        L"letter iffy 12abc abc12 1.5.6 ==>!",
+        L"function add(a, b) return a + b // sum \"quoted\"",
+        L"\"unterminated let x = 1",
+        L"Name other_Name Zeta9 x",
+        L"<<a <b> c> <<<",
+        L"\"\"\" <<\"<>",
+    };
+    
+    for (const wchar_t* text : texts) {
+        std::wstring value(text);
+        
+        // Scanning from the middle uses the characters before it as context only
+        for (size_t from = 0; from <= value.length(); from += std::max<size_t>(1, value.length() / 4)) {
+            std::vector<SyntaxToken> tokens;
+            lexer.Scan(value.c_str(), value.length(), from, tokens);
+            CHECK(SameTokens(tokens, ScanWithRegex(value, from)));
+        }
+    }
+}
+
+// Unterminated delimiters are read through once, not once per start position
+static void TestUnterminatedDelimiters() {
+    SyntaxLexer lexer;
+    CHECK(lexer.Compile(std::vector<std::wstring>(std::begin(PATTERNS), std::end(PATTERNS))));
+    
+    SyntaxLexer nested;
+    CHECK(nested.Compile(std::vector<std::wstring>(1, L"(a+)+b")));
+    
+    // Quadratic scans of these would take many seconds
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    std::vector<SyntaxToken> tokens;
+    CHECK(lexer.Scan(std::wstring(65536, L'<').c_str(), 65536, 0, tokens, &deadline));
+    CHECK(tokens.size() == 1);  // One operator run
+    tokens.clear();
+    CHECK(lexer.Scan(std::wstring(65536, L'"').c_str(), 65536, 0, tokens, &deadline));
+    CHECK(tokens.size() == 32768);  // Every pair of quotes
+    tokens.clear();
+    CHECK(nested.Scan(std::wstring(65536, L'a').c_str(), 65536, 0, tokens, &deadline));
+    CHECK(tokens.empty());
+    
+    // Past the deadline a scan gives up without adding tokens
+    tokens.clear();
+    auto past = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+    CHECK(!lexer.Scan(std::wstring(65536, L'<').c_str(), 65536, 0, tokens, &past));
+    CHECK(tokens.empty());
+}
+
+static void TestUnsupportedSyntax() {
+    SyntaxLexer lexer;
+    CHECK(!lexer.Compile(std::vector<std::wstring>(1, L"(a)\\1")));
+    CHECK(!lexer.IsCompiled());
+    CHECK(!lexer.Compile(std::vector<std::wstring>(1, L"a(?=b)")));
+    CHECK(lexer.Compile(std::vector<std::wstring>(1, L"[a-c]{2,3}x?")));
+}
+
+static void TestBacktrackProne() {
+    CHECK(SyntaxLexer::IsBacktrackProne(L"(a+)+b"));
+    CHECK(SyntaxLexer::IsBacktrackProne(L"(\\w+\\s?)*$"));
+    CHECK(SyntaxLexer::IsBacktrackProne(L"(a{1,})*"));
+    CHECK(!SyntaxLexer::IsBacktrackProne(L"\\b\\d+(\\.\\d+)?\\b"));
+    CHECK(!SyntaxLexer::IsBacktrackProne(L"\"[^\"]*\""));
+    CHECK(!SyntaxLexer::IsBacktrackProne(L"(ab)+c*"));
+    CHECK(!SyntaxLexer::IsBacktrackProne(L"[(+)]+"));
+}
+
+int main() {
+    TestMatchesRegex();
+    TestUnterminatedDelimiters();
+    TestUnsupportedSyntax();
+    TestBacktrackProne();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "check.h"
+#include "TextBuffer.h"
+
+// Edits at moving positions must read back like the same edits on a plain string
+
+static void CheckContents(TextBuffer& buffer, const std::wstring& expected) {
+    CHECK(buffer.GetLength() == expected.length());
+    CHECK(buffer.ToString().ToStdWstring() == expected);
+    
+    bool same = true;
+    for (size_t i = 0; i < expected.length(); i++) {
+        same = same && buffer[i] == expected[i];
+    }
+    CHECK(same);
+}
+
+static void TestEdits() {
+    TextBuffer buffer;
+    std::wstring expected;
+    CheckContents(buffer, expected);
+    
+    // Typing at the end grows the buffer past its initial gap
+    for (int i = 0; i < 200; i++) {
+        wchar_t c = (wchar_t)(L'a' + i % 26);
+        buffer.Replace(buffer.GetLength(), 0, wxString(std::wstring(1, c)));
+        expected += c;
+    }
+    CheckContents(buffer, expected);
+    
+    // Edits that move the gap backwards and forwards
+    buffer.Replace(10, 0, "XYZ");
+    expected.insert(10, L"XYZ");
+    buffer.Replace(150, 5, "");
+    expected.erase(150, 5);
+    buffer.Replace(0, 3, "start");
+    expected.replace(0, 3, L"start");
+    buffer.Replace(100, 20, "-");
+    expected.replace(100, 20, L"-");
+    CheckContents(buffer, expected);
+    
+    // Deleting everything and starting again
+    buffer.Replace(0, buffer.GetLength(), "new");
+    CheckContents(buffer, L"new");
+}
+
+static void TestMid() {
+    TextBuffer buffer(wxString("hello world"));
+    buffer.Replace(5, 0, ",");
+    CHECK(buffer.Mid(0, 6) == "hello,");
+    CHECK(buffer.Mid(3, 6) == "lo, wo");
+    CHECK(buffer.Mid(7, 100) == "world");
+    CHECK(buffer.Mid(12, 1).IsEmpty());
+    CHECK(buffer.Mid(50, 1).IsEmpty());
+}
+
+static void TestView() {
+    TextBuffer buffer(wxString("0123456789"));
+    buffer.Replace(5, 0, "ab");  // The gap now sits after "01234ab"
+    
+    // A view across the gap makes that range contiguous
+    const wchar_t* view = buffer.GetView(3, 9);
+    CHECK(std::wstring(view, 6) == L"34ab56");
+    view = buffer.GetView(0, buffer.GetLength());
+    CHECK(std::wstring(view, buffer.GetLength()) == L"01234ab56789");
+    CheckContents(buffer, L"01234ab56789");
+    
+    // An empty range still gives a valid pointer
+    CHECK(buffer.GetView(4, 4) != nullptr);
+}
+
+int main() {
+    TestEdits();
+    TestMid();
+    TestView();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,158 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 SyntaxTextCtrl Contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "check.h"
+#include "UndoJournal.h"
+
+// Coalescing of typing and deleting, and trimming to the memory budget
+
+static void TestTypingCoalesces() {
+    UndoJournal journal;
+    const wxString typed = "hello";
+    for (size_t i = 0; i < typed.length(); i++) {
+        journal.BeginStep(UndoJournal::EDIT_TYPING, i);
+        journal.Record(i, "", typed.Mid(i, 1));
+    }
+    
+    const UndoJournal::Step* step = journal.Undo();
+    CHECK(step != nullptr);
+    CHECK(step->deltas.size() == 1);
+    CHECK(step->deltas[0].pos == 0);
+    CHECK(step->deltas[0].inserted == "hello");
+    CHECK(step->cursorBefore == 0);
+    CHECK(!journal.CanUndo());
+    CHECK(journal.CanRedo());
+}
+
+static void TestBreaksCoalescing() {
+    UndoJournal journal;
+    journal.BeginStep(UndoJournal::EDIT_TYPING, 0);
+    journal.Record(0, "", "a");
+    journal.BreakCoalescing();
+    journal.BeginStep(UndoJournal::EDIT_TYPING, 1);
+    journal.Record(1, "", "b");
+    
+    // A different kind of edit starts a new step as well
+    journal.BeginStep(UndoJournal::EDIT_DELETE, 2);
+    journal.Record(1, "b", "");
+    
+    // So does typing somewhere else
+    journal.BeginStep(UndoJournal::EDIT_TYPING, 0);
+    journal.Record(0, "", "c");
+    journal.BeginStep(UndoJournal::EDIT_TYPING, 5);
+    journal.Record(5, "", "d");
+    
+    int steps = 0;
+    while (journal.Undo()) {
+        steps++;
+    }
+    CHECK(steps == 5);
+}
+
+static void TestDeletingCoalesces() {
+    UndoJournal journal;
+    
+    // Backspace from the end of "abcd"
+    journal.BeginStep(UndoJournal::EDIT_DELETE, 4);
+    journal.Record(3, "d", "");
+    journal.BeginStep(UndoJournal::EDIT_DELETE, 3);
+    journal.Record(2, "c", "");
+    
+    // Delete key at the same position
+    journal.BreakCoalescing();
+    journal.BeginStep(UndoJournal::EDIT_DELETE, 0);
+    journal.Record(0, "a", "");
+    journal.BeginStep(UndoJournal::EDIT_DELETE, 0);
+    journal.Record(0, "b", "");
+    
+    const UndoJournal::Step* step = journal.Undo();
+    CHECK(step != nullptr && step->deltas.size() == 1);
+    CHECK(step->deltas[0].pos == 0 && step->deltas[0].removed == "ab");
+    
+    step = journal.Undo();
+    CHECK(step != nullptr && step->deltas.size() == 1);
+    CHECK(step->deltas[0].pos == 2 && step->deltas[0].removed == "cd");
+    CHECK(step->cursorBefore == 4);
+}
+
+static void TestRedo() {
+    UndoJournal journal;
+    journal.BeginStep(UndoJournal::EDIT_OTHER, 0);
+    journal.Record(0, "", "x");
+    journal.BeginStep(UndoJournal::EDIT_OTHER, 1);
+    journal.Record(0, "x", "y");
+    
+    CHECK(journal.Undo() != nullptr);
+    const UndoJournal::Step* step = journal.Redo();
+    CHECK(step != nullptr && step->deltas[0].inserted == "y");
+    
+    // A new edit drops what could be redone
+    CHECK(journal.Undo() != nullptr);
+    journal.BeginStep(UndoJournal::EDIT_OTHER, 1);
+    journal.Record(1, "", "z");
+    CHECK(!journal.CanRedo());
+}
+
+static void TestTrimsToBudget() {
+    UndoJournal journal;
+    journal.SetBudget(4096);
+    for (size_t i = 0; i < 100; i++) {
+        journal.BeginStep(UndoJournal::EDIT_OTHER, 0);
+        journal.Record(0, "", wxString(std::wstring(50, L'x')));
+        CHECK(journal.GetMemoryUsage() <= journal.GetBudget());
+    }
+    
+    size_t steps = 0;
+    while (journal.Undo()) {
+        steps++;
+    }
+    CHECK(steps > 0 && steps < 100);
+    CHECK(journal.GetMemoryUsage() <= journal.GetBudget());
+    
+    // The newest step is kept even when it alone exceeds the budget
+    journal.Clear();
+    CHECK(journal.GetMemoryUsage() == 0);
+    journal.BeginStep(UndoJournal::EDIT_OTHER, 0);
+    journal.Record(0, "", wxString(std::wstring(8192, L'y')));
+    CHECK(journal.CanUndo());
+    
+    // Shrinking the budget drops the oldest steps first
+    journal.SetBudget(UndoJournal::DEFAULT_BUDGET);
+    journal.BeginStep(UndoJournal::EDIT_OTHER, 0);
+    journal.Record(0, "", "z");
+    journal.SetBudget(1);
+    const UndoJournal::Step* step = journal.Undo();
+    CHECK(step != nullptr && step->deltas[0].inserted == "z");
+    CHECK(!journal.CanUndo());
+}
+
+int main() {
+    TestTypingCoalesces();
+    TestBreaksCoalescing();
+    TestDeletingCoalesces();
+    TestRedo();
+    TestTrimsToBudget();
+    return CHECK_RESULT();
+}